@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <pqxx/pqxx>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "aggregators.hpp"
+#include "constants.hpp"
+#include "messages.hpp"
+#include "result_cache.hpp"
+#include "routing.hpp"
+#include "streaming.hpp"
+#include "transport.hpp"
+
+class TaskAggregator {
+private:
+    // A chunked result waiting for its chunks, which must arrive in seq order.
+    struct OpenStream {
+        size_t result;
+        int nextSeq{0};
+    };
+
+    // Payloads are retained until the task completes: parsed results borrow
+    // their top words from them, so each one is heap-pinned. Chunked results
+    // stay in openStreams until their last chunk arrives; a stream that
+    // loses a chunk leaves its result in failed, excluded from the total,
+    // and its sections count as failed.
+    struct TaskState {
+        std::vector<std::unique_ptr<std::string>> payloads;
+        std::vector<messages::ResultMessage> results;
+        std::unordered_map<long, OpenStream> openStreams;
+        std::unordered_set<size_t> failed;
+        // Section range (first -> last) of every batch taken, never
+        // overlapping. A batch can arrive twice when it was republished or
+        // re-issued to a second worker, possibly cut differently.
+        std::map<int, int> batches;
+        // Sections of the finished batches; as those are disjoint ranges
+        // within the text, reaching totalSections means full coverage.
+        int sectionsReceived{0};
+        int sectionsFailed{0};
+        int totalSections{0};
+        long startTime{0};
+    };
+
+    std::unordered_map<int, TaskState> tasks_;
+    // Recently completed tasks, so late duplicates don't open a new state.
+    std::unordered_set<int> completed_;
+    std::deque<int> completedOrder_;
+    static constexpr size_t completedHistory = 4096;
+
+    // Takes the batch's range unless it leaves the text or overlaps one
+    // already taken. Results without a firstSection cannot be checked.
+    static bool takeBatch(TaskState& state, const messages::ResultMessage& result)
+    {
+        if ( result.firstSection <= 0 ) { return true; }
+
+        int first = result.firstSection;
+        int last = first + result.sectionsCount - 1;
+        if ( last < first or last > result.totalSections ) {
+            std::cerr << "Error: Batch at section " << first << " of task " << result.taskId
+                      << " is outside the text, dropping it" << std::endl;
+            return false;
+        }
+
+        auto next = state.batches.upper_bound(last);
+        if ( next != state.batches.begin() and std::prev(next)->second >= first ) { return false; }
+
+        state.batches.emplace(first, last);
+        return true;
+    }
+
+    bool complete(int taskId, TaskState& state, messages::ResultMessage& total)
+    {
+        if ( state.sectionsReceived < state.totalSections ) { return false; }
+
+        if ( not state.failed.empty() ) {
+            size_t kept = 0;
+            for ( size_t i = 0; i < state.results.size(); ++i ) {
+                if ( state.failed.count(i) ) { continue; }
+                if ( kept != i ) { state.results[kept] = std::move(state.results[i]); }
+                ++kept;
+            }
+            state.results.resize(kept);
+        }
+
+        std::sort(state.results.begin(), state.results.end(),
+            [](const auto& a, const auto& b) {
+                return a.firstSection < b.firstSection;
+            });
+
+        total = messages::ResultMessage{};
+        total.taskId = taskId;
+        total.sectionsCount = state.sectionsReceived;
+        total.failedSections = state.sectionsFailed;
+        total.totalSections = state.totalSections;
+        total.startTime = state.startTime;
+
+        for ( auto aggregator : aggregators::aggregators ) {
+            aggregator(state.results, total);
+        }
+
+        tasks_.erase(taskId);
+        completed_.insert(taskId);
+        completedOrder_.push_back(taskId);
+        if ( completedOrder_.size() > completedHistory ) {
+            completed_.erase(completedOrder_.front());
+            completedOrder_.pop_front();
+        }
+        return true;
+    }
+
+    bool addResult(messages::ResultMessage&& result, std::unique_ptr<std::string> payload, messages::ResultMessage& total)
+    {
+        int taskId = result.taskId;
+        if ( completed_.count(taskId) ) { return false; }
+
+        auto& state = tasks_[taskId];
+        if ( not takeBatch(state, result) ) { return false; }
+
+        state.totalSections = result.totalSections;
+        state.startTime = result.startTime;
+
+        // A batch given up upstream carries no content, only its coverage.
+        if ( result.failedSections > 0 ) {
+            state.sectionsReceived += result.sectionsCount;
+            state.sectionsFailed += result.failedSections;
+            return complete(taskId, state, total);
+        }
+
+        if ( payload ) { state.payloads.push_back(std::move(payload)); }
+
+        if ( result.chunked ) {
+            state.openStreams[result.streamId] = {state.results.size()};
+            state.results.push_back(std::move(result));
+            return false;
+        }
+
+        state.sectionsReceived += result.sectionsCount;
+        state.results.push_back(std::move(result));
+        return complete(taskId, state, total);
+    }
+
+    bool addChunk(messages::ResultChunk&& chunk, messages::ResultMessage& total)
+    {
+        auto task = tasks_.find(chunk.taskId);
+        if ( task == tasks_.end() ) { return false; }
+
+        auto& state = task->second;
+        auto stream = state.openStreams.find(chunk.streamId);
+        if ( stream == state.openStreams.end() ) { return false; }
+
+        // Duplicates are dropped. A gap means a chunk was lost and nothing
+        // re-sends a result, so the batch's sections fail and the task still
+        // finishes, reported as failed.
+        auto& open = stream->second;
+        if ( chunk.seq < open.nextSeq ) { return false; }
+
+        auto& result = state.results[open.result];
+        if ( chunk.seq > open.nextSeq ) {
+            std::cerr << "Error: Lost chunk " << open.nextSeq << " of task " << chunk.taskId << " (batch at section "
+                      << result.firstSection << "), failing the batch" << std::endl;
+            state.failed.insert(open.result);
+            state.openStreams.erase(stream);
+            state.sectionsReceived += result.sectionsCount;
+            state.sectionsFailed += result.sectionsCount;
+            return complete(chunk.taskId, state, total);
+        }
+        ++open.nextSeq;
+
+        for ( auto& sentence : chunk.sortedSentences ) {
+            result.sortedSentences.push_back(std::move(sentence));
+        }
+        result.replacedText += chunk.text;
+
+        if ( not chunk.last ) { return false; }
+
+        state.openStreams.erase(stream);
+        state.sectionsReceived += result.sectionsCount;
+        return complete(chunk.taskId, state, total);
+    }
+
+public:
+    // Takes one worker result or chunk; once every section of its task is
+    // either done or failed, fills total and returns true. The payload is kept and its top words are
+    // borrowed.
+    bool add(std::unique_ptr<std::string> payload, messages::ResultMessage& total)
+    {
+        if ( messages::ResultChunk::isChunk(*payload) ) {
+            return addChunk(messages::ResultChunk::fromJson(*payload), total);
+        }
+
+        auto result = messages::ResultMessage::fromJson(*payload, true);
+        return addResult(std::move(result), std::move(payload), total);
+    }
+
+    // Same for a payload read in place from the transport: everything is
+    // copied out once and the buffer can be released right after.
+    bool add(std::string_view payload, messages::ResultMessage& total)
+    {
+        if ( messages::ResultChunk::isChunk(payload) ) {
+            return addChunk(messages::ResultChunk::fromJson(payload), total);
+        }
+
+        return addResult(messages::ResultMessage::fromJson(payload), nullptr, total);
+    }
+};
+
+// Stores a completed result for later tasks on the same content. A failure
+// only costs the cache entry.
+inline void cacheResult(pqxx::connection& conn, const messages::ResultMessage& total, std::string& output)
+{
+    try {
+        total.toJson(output);
+        db::storeResult(conn, total.taskId, output);
+    } catch ( const std::exception& e ) {
+        std::cerr << "Warning: Cannot cache result of task " << total.taskId << ": " << e.what() << std::endl;
+    }
+}
+
+// Marks the task finished, so the loader may reload its text. A failure
+// only delays that reload until the task is presumed lost.
+inline void finishTask(pqxx::connection& conn, const messages::ResultMessage& total)
+{
+    try {
+        pqxx::nontransaction txn(conn);
+        txn.exec_params("UPDATE tasks SET status = $2 WHERE id = $1", total.taskId,
+                        total.failedSections > 0 ? "failed" : "completed");
+    } catch ( const std::exception& e ) {
+        std::cerr << "Warning: Cannot mark task " << total.taskId << " finished: " << e.what() << std::endl;
+    }
+}
+
+// Consumes the results queue of one shard; see routing::resultShard. With
+// conn, finished tasks are marked in the tasks table and completed results
+// are stored in the result cache.
+inline int runAggregator(Transport& results, Transport& sink, int shard, const std::atomic<int>& run,
+                         pqxx::connection* conn = nullptr)
+{
+    auto resultsQueue = routing::resultsQueueName(shard);
+
+    if ( not results.declareQueue(resultsQueue) ) {
+        std::cerr << "Error: Cannot declare results queue" << std::endl;
+        return 1;
+    }
+
+    if ( not sink.declareQueue(SINKER_QUEUE_NAME) ) {
+        std::cerr << "Error: Cannot declare sinker queue" << std::endl;
+        return 1;
+    }
+
+    if ( not results.startConsuming(resultsQueue) ) {
+        std::cerr << "Error: Cannot start consuming" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Aggregator started on " << resultsQueue << "." << std::endl;
+
+    TaskAggregator aggregator;
+    messages::ResultMessage total;
+    std::string output;
+
+    while ( run ) {
+        bool completed = false;
+
+        if ( results.deliversInPlace() ) {
+            std::string_view message;
+            completed = results.receiveView(message, 1) and aggregator.add(message, total);
+        } else {
+            auto message = std::make_unique<std::string>();
+            completed = results.receiveMessage(*message, 1) and aggregator.add(std::move(message), total);
+        }
+
+        if ( completed ) {
+            int taskId = total.taskId;
+            if ( total.failedSections > 0 ) {
+                std::cerr << "Error: Task " << taskId << " lost " << total.failedSections << " of "
+                          << total.totalSections << " sections" << std::endl;
+            } else if ( conn and RESULT_CACHE_ENABLED ) {
+                cacheResult(*conn, total, output);
+            }
+            if ( conn ) { finishTask(*conn, total); }
+            if ( not streaming::sendResult(sink, SINKER_QUEUE_NAME, total, output) ) {
+                std::cerr << "Error: Cannot send result of task " << taskId << " to the sinker" << std::endl;
+            }
+        }
+    }
+
+    std::cout << "Shutting down aggregator..." << std::endl;
+    return 0;
+}
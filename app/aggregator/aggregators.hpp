@@ -19,15 +19,19 @@ static void topNAggregator(std::vector<messages::ResultMessage>& results, messag
 
     constexpr size_t top_n = 1000;
 
-    std::unordered_map<std::string, size_t> wordCounts;
-    for ( auto& r : results ) {
-        auto topWords = std::move(r.topWords);
-        for ( auto& [count, word] : topWords ) {
-            wordCounts[std::move(word)] += count;
+    // Keys view either the retained payloads (topWordRefs) or the owned
+    // topWords strings, so nothing is copied until the final top-N is cut.
+    std::unordered_map<std::string_view, size_t> wordCounts;
+    for ( const auto& r : results ) {
+        for ( const auto& [count, word] : r.topWordRefs ) {
+            wordCounts[word] += count;
+        }
+        for ( const auto& [count, word] : r.topWords ) {
+            wordCounts[word] += count;
         }
     }
 
-    std::vector<std::pair<size_t, std::string>> wordFreq;
+    std::vector<std::pair<size_t, std::string_view>> wordFreq;
     wordFreq.reserve(wordCounts.size());
     for ( const auto& [word, count] : wordCounts ) {
         wordFreq.emplace_back(count, word);
@@ -44,8 +48,11 @@ static void topNAggregator(std::vector<messages::ResultMessage>& results, messag
     if ( wordFreq.size() > top_n ) {
         wordFreq.resize(top_n);
     }
-        
-    total.topWords = std::move(wordFreq);
+
+    total.topWords.reserve(wordFreq.size());
+    for ( const auto& [count, word] : wordFreq ) {
+        total.topWords.emplace_back(count, std::string(word));
+    }
 }
 
 inline void sortSentencesAggregator(std::vector<messages::ResultMessage>& results, messages::ResultMessage& total)
@@ -1,103 +1,66 @@
-#include <chrono>
+#include <atomic>
 #include <iostream>
+#include <optional>
+#include <pqxx/pqxx>
+#include <string>
 #include <csignal>
-#include <algorithm>
-#include <sstream>
 
-// #include "aggregators.hpp"
-#include "aggregators.hpp"
+#include "aggregator.hpp"
+#include "args.hpp"
 #include "constants.hpp"
-#include "messages.hpp"
 #include "rabbitmq.hpp"
+#include "shm.hpp"
 
-static volatile int run = 1;
+static std::atomic<int> run = 1;
 
 static void stop(int sig) {
     run = 0;
 }
 
-// static std::optional<messages::ResultMessage> aggregateResults(std::vector<messages::ResultMessage>& results)
-// {
-//     if ( results.empty() ) { return {}; }
-
-//     auto type = results[0].type;
-//     if ( auto aggregator = aggregators::aggregators.find(type); aggregator != aggregators::aggregators.end() ) {
-//         auto result = (aggregator->second)(results);
-//         result.taskId = results[0].taskId;
-//         result.type = results[0].type;
-//         result.totalSections = results[0].totalSections;
-//         result.sectionsCount = 0;
-
-//         for ( const auto& r : results ) {
-//             result.sectionsCount += r.sectionsCount;
-//         }
-
-//         return result;
-//     } else {
-//         std::cerr << "Error: can't find aggregator for type " << messages::typeToString(type);
-//         return {};
-//     }
-// }
+static void printUsage() {
+    std::cout << "Usage: aggregator [<shard>]    shard in [0, " << RESULT_SHARDS << "), 0 by default" << std::endl;
+}
 
 int main(int argc, char* argv[]) {
     signal(SIGINT, stop);
     signal(SIGTERM, stop);
 
-    RabbitMQ rmq;
-
-    if ( not rmq.connect(RABBITMQ_HOST, RABBITMQ_PORT, RABBITMQ_USER, RABBITMQ_PASSWORD) ) {
-        std::cerr << "Error: Cannot connect to RabbitMQ" << std::endl;
+    int shard = 0;
+    if ( argc > 2 or (argc == 2 and not args::parseInt(argv[1], shard)) ) {
+        printUsage();
         return 1;
     }
-
-    if ( not rmq.declareQueue(RESULTS_QUEUE_NAME) ) {
-        std::cerr << "Error: Cannot declare results queue" << std::endl;
+    if ( shard < 0 or shard >= RESULT_SHARDS ) {
+        std::cerr << "Error: Shard must be in [0, " << RESULT_SHARDS << ")" << std::endl;
+        printUsage();
         return 1;
     }
 
-    if ( not rmq.declareQueue(SINKER_QUEUE_NAME) ) {
-        std::cerr << "Error: Cannot declare sinker queue" << std::endl;
-        return 1;
-    }
+    RabbitMQ rmq;
 
-    if ( not rmq.startConsuming(RESULTS_QUEUE_NAME) ) {
-        std::cerr << "Error: Cannot start consuming" << std::endl;
+    if ( not rmq.connect(RABBITMQ_HOST, RABBITMQ_PORT, RABBITMQ_USER, RABBITMQ_PASSWORD) ) {
+        std::cerr << "Error: Cannot connect to RabbitMQ" << std::endl;
         return 1;
     }
 
-    std::cout << "Aggregator started." << std::endl;
-
-    std::unordered_map<int, std::vector<messages::ResultMessage>> taskResults;
-
-    while ( run ) {
-        std::string message;
-
-        if ( rmq.receiveMessage(message, 1) ) {
-            auto result = messages::ResultMessage::fromJson(message);
-
-            taskResults[result.taskId].push_back(result);
-
-            int totalSectionsReceived = 0;
-            for ( const auto& r : taskResults[result.taskId] ) {
-                totalSectionsReceived += r.sectionsCount;
-            }
-
-            if ( totalSectionsReceived >= result.totalSections ) {
-                messages::ResultMessage total;
-                total.taskId = result.taskId;
-                total.totalSections = result.totalSections;
-                total.startTime = result.startTime;
+    if ( not rmq.setCompression(COMPRESSION_CODEC, COMPRESSION_THRESHOLD, COMPRESSION_DICTIONARY_PATH) ) {
+        std::cerr << "Warning: Compression is unavailable, publishing uncompressed" << std::endl;
+    }
 
-                for ( auto aggregator : aggregators::aggregators ) {
-                    aggregator(taskResults[result.taskId], total);
-                }
+    // Results still flow without the database, just uncached and with their
+    // tasks left unfinished there.
+    std::optional<pqxx::connection> dbConn;
+    try {
+        dbConn.emplace(DB_CONN_STRING);
+    } catch ( const std::exception& e ) {
+        std::cerr << "Warning: Cannot connect to database, tasks are not marked finished: " << e.what() << std::endl;
+    }
+    pqxx::connection* conn = dbConn ? &*dbConn : nullptr;
 
-                rmq.sendMessage(result.toJson(), SINKER_QUEUE_NAME);
-            }
-        }
+    if ( RESULTS_TRANSPORT == "shm" ) {
+        ShmTransport shm{SHM_RING_BYTES};
+        return runAggregator(shm, rmq, shard, run, conn);
     }
 
-    std::cout << "Shutting down aggregator..." << std::endl;
-    return 0;
+    return runAggregator(rmq, rmq, shard, run, conn);
 }
-
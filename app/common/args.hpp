@@ -0,0 +1,24 @@
+#pragma once
+
+#include <exception>
+#include <limits>
+#include <string>
+
+// Command-line parsing shared by the stage binaries.
+namespace args {
+
+// The whole argument must be a number of at least min.
+inline bool parseInt(const std::string& arg, int& value, int min = std::numeric_limits<int>::min())
+{
+    try {
+        size_t parsed = 0;
+        int parsedValue = std::stoi(arg, &parsed);
+        if ( parsed != arg.size() or parsedValue < min ) { return false; }
+        value = parsedValue;
+        return true;
+    } catch ( const std::exception& ) {
+        return false;
+    }
+}
+
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+// Payload codecs for the messaging layer. The codec name doubles as the AMQP
+// content-encoding value, so receivers decode whatever the sender picked.
+namespace compression {
+
+enum class Codec {
+    None,
+    Lz4,
+    Zstd,
+    // A content-encoding this build does not know; never decoded.
+    Unknown,
+};
+
+// Upper bound on a decompressed payload. Frame headers come from the
+// sender, so a corrupt or hostile one must not size the output freely.
+inline const size_t MAX_DECOMPRESSED_BYTES = 256 << 20;
+
+inline std::string_view codecName(Codec codec)
+{
+    switch ( codec ) {
+        case Codec::Lz4: return "lz4";
+        case Codec::Zstd: return "zstd";
+        default: return "";
+    }
+}
+
+inline Codec codecFromName(std::string_view name)
+{
+    if ( name.empty() or name == "identity" ) { return Codec::None; }
+    if ( name == "lz4" ) { return Codec::Lz4; }
+    if ( name == "zstd" ) { return Codec::Zstd; }
+    return Codec::Unknown;
+}
+
+inline bool isAvailable(Codec codec)
+{
+    switch ( codec ) {
+        case Codec::None: return true;
+#ifdef HAVE_LZ4
+        case Codec::Lz4: return true;
+#endif
+#ifdef HAVE_ZSTD
+        case Codec::Zstd: return true;
+#endif
+        default: return false;
+    }
+}
+
+class Compressor {
+private:
+#ifdef HAVE_ZSTD
+    struct ZstdDeleter {
+        void operator()(ZSTD_CCtx* ctx) const { ZSTD_freeCCtx(ctx); }
+        void operator()(ZSTD_DCtx* ctx) const { ZSTD_freeDCtx(ctx); }
+        void operator()(ZSTD_CDict* dict) const { ZSTD_freeCDict(dict); }
+        void operator()(ZSTD_DDict* dict) const { ZSTD_freeDDict(dict); }
+    };
+
+    std::unique_ptr<ZSTD_CCtx, ZstdDeleter> cctx_{ZSTD_createCCtx()};
+    std::unique_ptr<ZSTD_DCtx, ZstdDeleter> dctx_{ZSTD_createDCtx()};
+    std::unique_ptr<ZSTD_CDict, ZstdDeleter> cdict_;
+    std::unique_ptr<ZSTD_DDict, ZstdDeleter> ddict_;
+#endif
+    int level_{3};
+
+#ifdef HAVE_ZSTD
+    // Decompresses one frame onto the end of output.
+    bool zstdAppend(std::string_view input, std::string& output)
+    {
+        auto size = ZSTD_getFrameContentSize(input.data(), input.size());
+        if ( size == ZSTD_CONTENTSIZE_ERROR or size == ZSTD_CONTENTSIZE_UNKNOWN ) { return false; }
+        if ( size > MAX_DECOMPRESSED_BYTES ) { return false; }
+
+        unsigned dictId = ZSTD_getDictID_fromFrame(input.data(), input.size());
+        if ( dictId != 0 and (not ddict_ or ZSTD_getDictID_fromDDict(ddict_.get()) != dictId) ) {
+            return false;
+        }
+
+        size_t offset = output.size();
+        output.resize(offset + size);
+        size_t written = dictId != 0
+            ? ZSTD_decompress_usingDDict(dctx_.get(), output.data() + offset, size,
+                                         input.data(), input.size(), ddict_.get())
+            : ZSTD_decompressDCtx(dctx_.get(), output.data() + offset, size,
+                                  input.data(), input.size());
+        if ( ZSTD_isError(written) ) {
+            output.resize(offset);
+            return false;
+        }
+        output.resize(offset + written);
+        return true;
+    }
+#endif
+
+public:
+    explicit Compressor(int level = 3) : level_(level) {}
+
+    // Loads a dictionary produced by `zstd --train` on sample payloads. It is
+    // used for every zstd frame this side writes; frames are tagged with the
+    // dictionary id, so receivers without it fail loudly instead of
+    // producing garbage.
+    bool loadDictionary(const std::string& path)
+    {
+#ifdef HAVE_ZSTD
+        std::ifstream file(path, std::ios::binary);
+        if ( not file ) { return false; }
+
+        std::string dict((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        cdict_.reset(ZSTD_createCDict(dict.data(), dict.size(), level_));
+        ddict_.reset(ZSTD_createDDict(dict.data(), dict.size()));
+        return cdict_ and ddict_;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    bool compress(Codec codec, std::string_view input, std::string& output)
+    {
+        switch ( codec ) {
+#ifdef HAVE_ZSTD
+            case Codec::Zstd: {
+                output.resize(ZSTD_compressBound(input.size()));
+                size_t size = cdict_
+                    ? ZSTD_compress_usingCDict(cctx_.get(), output.data(), output.size(),
+                                               input.data(), input.size(), cdict_.get())
+                    : ZSTD_compressCCtx(cctx_.get(), output.data(), output.size(),
+                                        input.data(), input.size(), level_);
+                if ( ZSTD_isError(size) ) { return false; }
+                output.resize(size);
+                return true;
+            }
+#endif
+#ifdef HAVE_LZ4
+            case Codec::Lz4: {
+                LZ4F_preferences_t prefs{};
+                prefs.frameInfo.contentSize = input.size();
+                output.resize(LZ4F_compressFrameBound(input.size(), &prefs));
+                size_t size = LZ4F_compressFrame(output.data(), output.size(),
+                                                 input.data(), input.size(), &prefs);
+                if ( LZ4F_isError(size) ) { return false; }
+                output.resize(size);
+                return true;
+            }
+#endif
+            default:
+                return false;
+        }
+    }
+
+    bool decompress(Codec codec, std::string_view input, std::string& output)
+    {
+        switch ( codec ) {
+            case Codec::None:
+                output.assign(input.data(), input.size());
+                return true;
+#ifdef HAVE_ZSTD
+            case Codec::Zstd:
+                output.clear();
+                return zstdAppend(input, output);
+#endif
+#ifdef HAVE_LZ4
+            case Codec::Lz4: {
+                LZ4F_dctx* dctx = nullptr;
+                if ( LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION)) ) { return false; }
+                std::unique_ptr<LZ4F_dctx, decltype(&LZ4F_freeDecompressionContext)> guard{
+                    dctx, LZ4F_freeDecompressionContext};
+
+                LZ4F_frameInfo_t info{};
+                size_t consumed = input.size();
+                size_t hint = LZ4F_getFrameInfo(dctx, &info, input.data(), &consumed);
+                if ( LZ4F_isError(hint) ) { return false; }
+                if ( info.contentSize > MAX_DECOMPRESSED_BYTES ) { return false; }
+
+                output.resize(info.contentSize);
+                size_t srcPos = consumed;
+                size_t dstPos = 0;
+                while ( hint != 0 and srcPos < input.size() ) {
+                    size_t srcSize = input.size() - srcPos;
+                    size_t dstSize = output.size() - dstPos;
+                    hint = LZ4F_decompress(dctx, output.data() + dstPos, &dstSize,
+                                           input.data() + srcPos, &srcSize, nullptr);
+                    if ( LZ4F_isError(hint) ) { return false; }
+                    // Frames without a content size, or lying about it, stall here.
+                    if ( srcSize == 0 and dstSize == 0 ) { return false; }
+                    srcPos += srcSize;
+                    dstPos += dstSize;
+                }
+                // A truncated frame leaves the decoder expecting more input.
+                if ( hint != 0 ) { return false; }
+                output.resize(dstPos);
+                return true;
+            }
+#endif
+            default:
+                return false;
+        }
+    }
+
+    // Like decompress, but keeps what output already holds, so many payloads
+    // can be unpacked back to back into one reused buffer.
+    bool decompressAppend(Codec codec, std::string_view input, std::string& output)
+    {
+        switch ( codec ) {
+            case Codec::None:
+                output.append(input.data(), input.size());
+                return true;
+#ifdef HAVE_ZSTD
+            case Codec::Zstd:
+                return zstdAppend(input, output);
+#endif
+            default: {
+                std::string decoded;
+                if ( not decompress(codec, input, decoded) ) { return false; }
+                output += decoded;
+                return true;
+            }
+        }
+    }
+};
+
+}
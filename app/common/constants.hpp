@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 inline const std::string DB_HOST = "localhost";
@@ -18,7 +19,112 @@ inline const int RABBITMQ_PORT = 5672;
 inline const std::string RABBITMQ_USER = "guest";
 inline const std::string RABBITMQ_PASSWORD = "guest";
 inline const std::string QUEUE_NAME = "text-processing-tasks";
+// Concurrent task submissions in the splitter's bulk mode.
+inline const int SPLITTER_JOBS = 8;
+// The pipeline benchmark gives up when no task finished for this long.
+inline const int PIPELINE_IDLE_TIMEOUT_SEC = 120;
+// The loader does not reload a text while a task on it is unfinished; a
+// task unfinished after this long is presumed lost.
+inline const int RELOAD_TASK_TIMEOUT_SEC = 3600;
+
+// With the scheduler enabled the splitter publishes into per-tenant lanes
+// and the scheduler feeds QUEUE_NAME from them by weighted round-robin.
+// Enabling it requires running the `scheduler` binary next to the other
+// stages; without one, nothing reaches the workers.
+inline const bool SCHEDULER_ENABLED = false;
+inline const std::string LANE_QUEUE_PREFIX = QUEUE_NAME + ".lane.";
+inline const std::string PRIORITY_QUEUE_NAME = QUEUE_NAME + ".priority";
+inline const int TENANT_LANES = 8;
+inline const int PRIORITY_LANE_WEIGHT = 4;
+// Tasks this small go through the priority lane.
+inline const int SMALL_TASK_SECTIONS = 64;
+// How many batches the scheduler lets wait in QUEUE_NAME.
+inline const long SCHEDULER_MAX_QUEUED = 16;
+// Text affinity, push mode with the scheduler only: batches go to one of
+// WORKER_GROUPS group queues by consistent hashing of text_id, so a text
+// keeps hitting the same workers' warm caches. A group queue holding
+// GROUP_MAX_QUEUED batches, or without consumers, overflows into
+// QUEUE_NAME, which workers drain whenever their group queue is empty.
+// 0 disables.
+inline const int WORKER_GROUPS = 0;
+inline const std::string GROUP_QUEUE_PREFIX = QUEUE_NAME + ".group.";
+inline const long GROUP_MAX_QUEUED = 8;
+inline const int GROUP_VIRTUAL_NODES = 64;
+// "push": workers take batches from QUEUE_NAME as the broker delivers them.
+// "pull": each worker asks the scheduler for work and gets a sub-range
+// sized to about PULL_TARGET_SECONDS at its recent rate, on its own queue.
+inline const std::string WORK_DISTRIBUTION = "push";
+inline const std::string WORK_REQUESTS_QUEUE_NAME = QUEUE_NAME + ".requests";
+inline const std::string WORKER_QUEUE_PREFIX = QUEUE_NAME + ".worker.";
+// Never carries messages: pull workers hold a consumer on it so the
+// splitter can count them.
+inline const std::string WORKER_PRESENCE_QUEUE_NAME = QUEUE_NAME + ".workers";
+inline const double PULL_TARGET_SECONDS = 2.0;
+inline const int PULL_MIN_SECTIONS = 16;
+// A worker repeats its request when nothing arrived for this long.
+inline const int WORK_REQUEST_TIMEOUT_SEC = 10;
+// Pull mode hands a batch to a second worker once it is out for longer than
+// SPECULATION_FACTOR times the SPECULATION_PERCENTILE per-section latency of
+// recent batches (at least SPECULATION_MIN_SECONDS). Until enough samples
+// exist, SPECULATION_FALLBACK_SECONDS applies.
+inline const double SPECULATION_PERCENTILE = 0.95;
+inline const double SPECULATION_FACTOR = 1.5;
+inline const double SPECULATION_MIN_SECONDS = 5.0;
+inline const double SPECULATION_FALLBACK_SECONDS = 60.0;
+inline const size_t SPECULATION_MIN_SAMPLES = 20;
+// A batch is handed out at most this many times, each deadline twice the
+// one before; past the last it is reported to the aggregator as failed.
+inline const int SPECULATION_MAX_ISSUES = 3;
 inline const std::string RESULTS_QUEUE_NAME = "text-processing-results";
+// One aggregator instance per shard; results are routed by task id.
+inline const int RESULT_SHARDS = 1;
 inline const std::string SINKER_QUEUE_NAME = "text-processing-final-results";
 
-inline const int BATCH_SIZE = 256;
\ No newline at end of file
+// "amqp", or "shm" when workers and the aggregator share a host and results
+// should go through a shared-memory ring instead of the broker.
+inline const std::string RESULTS_TRANSPORT = "amqp";
+inline const size_t SHM_RING_BYTES = 64 << 20;
+
+// Size of the host-wide shared-memory cache of section contents that
+// workers consult before Postgres; 0 disables it. Mind the size of /dev/shm
+// (64 MiB by default in containers) before raising it.
+inline const size_t SECTION_CACHE_BYTES = 0;
+inline const std::string SECTION_CACHE_NAME = "/textproc.sections";
+
+// Results with more sentence and text bytes than this are streamed as a head
+// message plus chunks of about this size.
+inline const size_t RESULT_CHUNK_BYTES = 120 * 1024;
+
+// Final results are cached by text content and RESULT_CACHE_PARAMS, and a
+// task for a text with a cached result goes straight to the sinker. The
+// params name the analysis set: change them whenever a handler or an
+// aggregator changes its output.
+inline const bool RESULT_CACHE_ENABLED = true;
+inline const std::string RESULT_CACHE_PARAMS = "words,top1000,tonality,sentences,replace/1";
+
+// "zstd", "lz4" or "" to publish uncompressed. Messages below the threshold
+// are always sent as-is; the dictionary is optional (see `zstd --train`).
+inline const std::string COMPRESSION_CODEC = "zstd";
+inline const size_t COMPRESSION_THRESHOLD = 4096;
+inline const std::string COMPRESSION_DICTIONARY_PATH = "";
+
+// The loader cuts texts into sections of at most LOADER_SECTION_BYTES and
+// streams files through memory LOADER_BLOCK_BYTES at a time.
+inline const size_t LOADER_SECTION_BYTES = 1024;
+inline const size_t LOADER_BLOCK_BYTES = 8 << 20;
+
+// Batches are cut by section bytes: about BATCHES_PER_CONSUMER batches per
+// live worker, each between BATCH_MIN_BYTES and BATCH_MAX_BYTES and never
+// over BATCH_SIZE sections. Texts under BATCH_MIN_BYTES go out as one batch.
+inline const int BATCH_SIZE = 256;
+inline const size_t BATCH_MIN_BYTES = 64 * 1024;
+inline const size_t BATCH_MAX_BYTES = 4 << 20;
+inline const int BATCHES_PER_CONSUMER = 4;
+// Per-section cost on top of its bytes: row fetch and message overhead.
+inline const size_t SECTION_COST_BYTES = 512;
+
+// Push mode: the splitter embeds section contents in batches of up to
+// PUSH_MAX_BATCH_BYTES so workers skip the database; larger batches still
+// carry ids only. Payload compression is the transport's (see above).
+inline const bool PUSH_SECTIONS = true;
+inline const size_t PUSH_MAX_BATCH_BYTES = 1 << 20;
\ No newline at end of file
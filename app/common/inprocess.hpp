@@ -0,0 +1,223 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "transport.hpp"
+
+namespace inprocess {
+
+// Bounded lock-free multi-producer/multi-consumer queue (Vyukov). Each cell
+// carries a sequence number telling producers and consumers whose turn it is.
+class MessageQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        std::string message;
+    };
+
+    static constexpr size_t cacheLine = 64;
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(cacheLine) std::atomic<size_t> enqueuePos_{0};
+    alignas(cacheLine) std::atomic<size_t> dequeuePos_{0};
+    std::atomic<long> consumers_{0};
+
+public:
+    // Capacity is rounded up to a power of two.
+    explicit MessageQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while ( size < capacity ) { size <<= 1; }
+
+        cells_ = std::make_unique<Cell[]>(size);
+        mask_ = size - 1;
+        for ( size_t i = 0; i < size; ++i ) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPush(std::string& message)
+    {
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for ( ;; ) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if ( diff == 0 ) {
+                if ( enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) ) {
+                    cell.message = std::move(message);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if ( diff < 0 ) {
+                return false;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(std::string& message)
+    {
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        for ( ;; ) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if ( diff == 0 ) {
+                if ( dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) ) {
+                    message = std::move(cell.message);
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if ( diff < 0 ) {
+                return false;
+            } else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t approximateSize() const
+    {
+        size_t enqueued = enqueuePos_.load(std::memory_order_relaxed);
+        size_t dequeued = dequeuePos_.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    void addConsumer()
+    {
+        consumers_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    long consumerCount() const
+    {
+        return consumers_.load(std::memory_order_relaxed);
+    }
+};
+
+// Registry of named queues shared by all transports of one process. The
+// mutex only guards declaration; transports cache the queue pointers they use.
+class Broker {
+private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::unique_ptr<MessageQueue>> queues_;
+    size_t capacity_;
+
+public:
+    explicit Broker(size_t capacity = 4096) : capacity_(capacity) {}
+
+    Broker(const Broker&) = delete;
+    Broker& operator=(const Broker&) = delete;
+
+    MessageQueue* declare(const std::string& queueName)
+    {
+        std::lock_guard lock(mutex_);
+        auto& queue = queues_[queueName];
+        if ( not queue ) { queue = std::make_unique<MessageQueue>(capacity_); }
+        return queue.get();
+    }
+};
+
+// Spins briefly, then yields, then sleeps, so idle consumers don't burn a core.
+class Backoff {
+private:
+    unsigned step_{0};
+
+public:
+    void pause()
+    {
+        if ( step_ < 64 ) {
+            ++step_;
+        } else if ( step_ < 128 ) {
+            ++step_;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+};
+
+}
+
+class InProcessTransport : public Transport {
+private:
+    inprocess::Broker& broker_;
+    std::unordered_map<std::string, inprocess::MessageQueue*> queues_;
+    inprocess::MessageQueue* consumed_{nullptr};
+
+    inprocess::MessageQueue* lookup(const std::string& queueName)
+    {
+        if ( auto it = queues_.find(queueName); it != queues_.end() ) { return it->second; }
+        return queues_[queueName] = broker_.declare(queueName);
+    }
+
+public:
+    explicit InProcessTransport(inprocess::Broker& broker) : broker_(broker) {}
+
+    bool declareQueue(const std::string& queueName) override
+    {
+        lookup(queueName);
+        return true;
+    }
+
+    // Blocks while the queue is full: that is the backpressure a bounded
+    // broker queue would apply.
+    bool sendMessage(const std::string& message, const std::string& queueName) override
+    {
+        auto* queue = lookup(queueName);
+        std::string copy = message;
+        inprocess::Backoff backoff;
+        while ( not queue->tryPush(copy) ) { backoff.pause(); }
+        return true;
+    }
+
+    bool startConsuming(const std::string& queueName) override
+    {
+        consumed_ = lookup(queueName);
+        consumed_->addConsumer();
+        return true;
+    }
+
+    bool receiveMessage(std::string& message, int timeout_sec = 1) override
+    {
+        if ( not consumed_ ) { return false; }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_sec);
+        inprocess::Backoff backoff;
+        while ( not consumed_->tryPop(message) ) {
+            if ( std::chrono::steady_clock::now() >= deadline ) { return false; }
+            backoff.pause();
+        }
+        return true;
+    }
+
+    bool getMessage(const std::string& queueName, std::string& message) override
+    {
+        return lookup(queueName)->tryPop(message);
+    }
+
+    long messageCount(const std::string& queueName) override
+    {
+        return lookup(queueName)->approximateSize();
+    }
+
+    long consumerCount(const std::string& queueName) override
+    {
+        return lookup(queueName)->consumerCount();
+    }
+
+    bool isConnected() const override
+    {
+        return true;
+    }
+};
@@ -0,0 +1,400 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Minimal streaming JSON codec for the hot message types. The writer appends
+// directly into a caller-owned buffer, the reader walks the received payload
+// without building a DOM and hands out string views into it where possible.
+namespace json_stream {
+
+class Writer {
+private:
+    std::string& out_;
+    bool needComma_{false};
+
+    void separator()
+    {
+        if ( needComma_ ) { out_ += ','; }
+        needComma_ = true;
+    }
+
+    void appendEscaped(std::string_view str)
+    {
+        static constexpr char hex[] = "0123456789abcdef";
+
+        out_ += '"';
+        size_t runStart = 0;
+        for ( size_t i = 0; i < str.size(); ++i ) {
+            unsigned char c = static_cast<unsigned char>(str[i]);
+            if ( c >= 0x20 and c != '"' and c != '\\' ) { continue; }
+
+            out_.append(str, runStart, i - runStart);
+            runStart = i + 1;
+            switch ( c ) {
+                case '"':  out_ += "\\\""; break;
+                case '\\': out_ += "\\\\"; break;
+                case '\n': out_ += "\\n"; break;
+                case '\r': out_ += "\\r"; break;
+                case '\t': out_ += "\\t"; break;
+                case '\b': out_ += "\\b"; break;
+                case '\f': out_ += "\\f"; break;
+                default:
+                    out_ += "\\u00";
+                    out_ += hex[c >> 4];
+                    out_ += hex[c & 0xF];
+            }
+        }
+        out_.append(str, runStart, std::string_view::npos);
+        out_ += '"';
+    }
+
+public:
+    explicit Writer(std::string& out) : out_(out) {}
+
+    Writer& beginObject() { separator(); out_ += '{'; needComma_ = false; return *this; }
+    Writer& endObject() { out_ += '}'; needComma_ = true; return *this; }
+    Writer& beginArray() { separator(); out_ += '['; needComma_ = false; return *this; }
+    Writer& endArray() { out_ += ']'; needComma_ = true; return *this; }
+
+    Writer& key(std::string_view name)
+    {
+        separator();
+        appendEscaped(name);
+        out_ += ':';
+        needComma_ = false;
+        return *this;
+    }
+
+    Writer& value(std::string_view str) { separator(); appendEscaped(str); return *this; }
+    Writer& value(const char* str) { return value(std::string_view{str}); }
+    Writer& value(const std::string& str) { return value(std::string_view{str}); }
+    Writer& value(bool b) { separator(); out_ += b ? "true" : "false"; return *this; }
+    Writer& value(int v) { separator(); out_ += std::to_string(v); return *this; }
+    Writer& value(long v) { separator(); out_ += std::to_string(v); return *this; }
+    Writer& value(long long v) { separator(); out_ += std::to_string(v); return *this; }
+    Writer& value(unsigned long v) { separator(); out_ += std::to_string(v); return *this; }
+    Writer& value(unsigned long long v) { separator(); out_ += std::to_string(v); return *this; }
+
+    template <typename T>
+    Writer& field(std::string_view name, const T& v) { return key(name).value(v); }
+};
+
+class Reader {
+private:
+    std::string_view in_;
+    size_t pos_{0};
+    // No element of the innermost open container has been read yet.
+    bool first_{false};
+
+    [[noreturn]] void fail(const char* what) const
+    {
+        throw std::runtime_error(std::string("json_stream: ") + what + " at offset " + std::to_string(pos_));
+    }
+
+    void skipWhitespace()
+    {
+        while ( pos_ < in_.size() and
+                (in_[pos_] == ' ' or in_[pos_] == '\n' or in_[pos_] == '\r' or in_[pos_] == '\t') ) {
+            ++pos_;
+        }
+    }
+
+    void expect(char c)
+    {
+        skipWhitespace();
+        if ( pos_ >= in_.size() or in_[pos_] != c ) { fail("unexpected character"); }
+        ++pos_;
+    }
+
+    bool isDigit() const
+    {
+        return pos_ < in_.size() and in_[pos_] >= '0' and in_[pos_] <= '9';
+    }
+
+    // Returns false if there was no digit to skip.
+    bool skipDigits()
+    {
+        size_t start = pos_;
+        while ( isDigit() ) { ++pos_; }
+        return pos_ > start;
+    }
+
+    // Offsets of the parts of a number in in_, checked against the JSON
+    // grammar. Exponents are clamped; anything that large is out of range
+    // or zero anyway.
+    struct Number {
+        bool negative{false};
+        size_t integer{0};
+        size_t integerEnd{0};
+        size_t fraction{0};
+        size_t fractionEnd{0};
+        long exponent{0};
+    };
+
+    Number scanNumber()
+    {
+        static constexpr long maxExponent = 1'000;
+
+        skipWhitespace();
+        Number number;
+        size_t start = pos_;
+        if ( pos_ < in_.size() and in_[pos_] == '-' ) { number.negative = true; ++pos_; }
+
+        number.integer = pos_;
+        if ( not skipDigits() ) {
+            pos_ = start;
+            fail("expected number");
+        }
+        number.integerEnd = number.fraction = number.fractionEnd = pos_;
+        if ( pos_ - number.integer > 1 and in_[number.integer] == '0' ) { fail("leading zero in number"); }
+
+        if ( pos_ < in_.size() and in_[pos_] == '.' ) {
+            number.fraction = ++pos_;
+            if ( not skipDigits() ) { fail("expected fraction digits"); }
+            number.fractionEnd = pos_;
+        }
+        if ( pos_ < in_.size() and (in_[pos_] == 'e' or in_[pos_] == 'E') ) {
+            ++pos_;
+            bool negative = false;
+            if ( pos_ < in_.size() and (in_[pos_] == '+' or in_[pos_] == '-') ) { negative = in_[pos_++] == '-'; }
+            if ( not isDigit() ) { fail("expected exponent digits"); }
+            while ( isDigit() ) {
+                number.exponent = std::min(number.exponent * 10 + (in_[pos_++] - '0'), maxExponent);
+            }
+            if ( negative ) { number.exponent = -number.exponent; }
+        }
+        return number;
+    }
+
+    void expectLiteral(std::string_view literal)
+    {
+        if ( in_.substr(pos_, literal.size()) != literal ) { fail("invalid literal"); }
+        pos_ += literal.size();
+    }
+
+    unsigned readHex4()
+    {
+        if ( pos_ + 4 > in_.size() ) { fail("truncated \\u escape"); }
+        unsigned code = 0;
+        for ( int i = 0; i < 4; ++i ) {
+            char c = in_[pos_++];
+            code <<= 4;
+            if ( c >= '0' and c <= '9' ) { code |= c - '0'; }
+            else if ( c >= 'a' and c <= 'f' ) { code |= c - 'a' + 10; }
+            else if ( c >= 'A' and c <= 'F' ) { code |= c - 'A' + 10; }
+            else { fail("invalid \\u escape"); }
+        }
+        return code;
+    }
+
+    static void appendUtf8(std::string& out, unsigned code)
+    {
+        if ( code < 0x80 ) {
+            out += static_cast<char>(code);
+        } else if ( code < 0x800 ) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if ( code < 0x10000 ) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+public:
+    explicit Reader(std::string_view in) : in_(in) {}
+
+    size_t position() const { return pos_; }
+
+    void beginObject() { expect('{'); first_ = true; }
+    void beginArray() { expect('['); first_ = true; }
+
+    // Advances past the next member separator. Returns false once the closing
+    // bracket is consumed. Call before every member/element, including the first.
+    // Elements are separated by exactly one comma; a trailing one makes the
+    // following value fail to parse.
+    bool next(char closing)
+    {
+        skipWhitespace();
+        if ( pos_ >= in_.size() ) { fail("unterminated container"); }
+        if ( in_[pos_] == closing ) {
+            ++pos_;
+            // Back in the parent, which has just read this container.
+            first_ = false;
+            return false;
+        }
+
+        if ( first_ ) {
+            first_ = false;
+            return true;
+        }
+
+        if ( in_[pos_] != ',' ) { fail("expected ','"); }
+        ++pos_;
+        skipWhitespace();
+        return true;
+    }
+
+    bool nextMember() { return next('}'); }
+    bool nextElement() { return next(']'); }
+
+    // Reads a string. The result views the input buffer directly when the
+    // string has no escapes; otherwise it is unescaped into scratch and views
+    // that instead.
+    std::string_view readString(std::string& scratch)
+    {
+        expect('"');
+        size_t start = pos_;
+        while ( pos_ < in_.size() and in_[pos_] != '"' and in_[pos_] != '\\' ) { ++pos_; }
+        if ( pos_ >= in_.size() ) { fail("unterminated string"); }
+        if ( in_[pos_] == '"' ) { return in_.substr(start, pos_++ - start); }
+
+        scratch.assign(in_.data() + start, pos_ - start);
+        while ( pos_ < in_.size() and in_[pos_] != '"' ) {
+            char c = in_[pos_++];
+            if ( c != '\\' ) { scratch += c; continue; }
+            if ( pos_ >= in_.size() ) { break; }
+
+            switch ( in_[pos_++] ) {
+                case '"':  scratch += '"'; break;
+                case '\\': scratch += '\\'; break;
+                case '/':  scratch += '/'; break;
+                case 'n':  scratch += '\n'; break;
+                case 'r':  scratch += '\r'; break;
+                case 't':  scratch += '\t'; break;
+                case 'b':  scratch += '\b'; break;
+                case 'f':  scratch += '\f'; break;
+                case 'u': {
+                    unsigned code = readHex4();
+                    if ( code >= 0xD800 and code <= 0xDBFF and
+                         in_.substr(pos_, 2) == "\\u" ) {
+                        pos_ += 2;
+                        unsigned low = readHex4();
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(scratch, code);
+                    break;
+                }
+                default: fail("invalid escape");
+            }
+        }
+        if ( pos_ >= in_.size() ) { fail("unterminated string"); }
+        ++pos_;
+        return scratch;
+    }
+
+    std::string_view readKey(std::string& scratch)
+    {
+        auto key = readString(scratch);
+        expect(':');
+        return key;
+    }
+
+    // Reads a number as an integer: a fraction is truncated away the way
+    // nlohmann's get<int>() would, after the exponent moves the point.
+    // Values outside long long fail rather than wrap.
+    long long readInteger()
+    {
+        auto number = scanNumber();
+
+        // Mantissa digits are the integer part followed by the fraction; the
+        // integer value keeps the first `point` of them, zero-padded.
+        std::string_view integer = in_.substr(number.integer, number.integerEnd - number.integer);
+        std::string_view fraction = in_.substr(number.fraction, number.fractionEnd - number.fraction);
+        long point = static_cast<long>(integer.size()) + number.exponent;
+
+        unsigned long long limit = std::numeric_limits<long long>::max();
+        if ( number.negative ) { ++limit; }
+        unsigned long long v = 0;
+        for ( long i = 0; i < point; ++i ) {
+            size_t at = static_cast<size_t>(i);
+            int digit = at < integer.size() ? integer[at] - '0'
+                      : at - integer.size() < fraction.size() ? fraction[at - integer.size()] - '0' : 0;
+            if ( v == 0 and digit == 0 ) { continue; }
+            if ( v > (limit - digit) / 10 ) { fail("number out of range"); }
+            v = v * 10 + digit;
+        }
+
+        if ( not number.negative ) { return static_cast<long long>(v); }
+        return v == limit ? std::numeric_limits<long long>::min() : -static_cast<long long>(v);
+    }
+
+    // readInteger narrowed to T; values T cannot hold fail.
+    template <typename T>
+    T readInteger()
+    {
+        long long v = readInteger();
+        if ( v < static_cast<long long>(std::numeric_limits<T>::min()) or
+             (v > 0 and static_cast<unsigned long long>(v) > static_cast<unsigned long long>(std::numeric_limits<T>::max())) ) {
+            fail("number out of range");
+        }
+        return static_cast<T>(v);
+    }
+
+    bool readBool()
+    {
+        skipWhitespace();
+        if ( pos_ < in_.size() and in_[pos_] == 't' ) { expectLiteral("true"); return true; }
+        expectLiteral("false");
+        return false;
+    }
+
+    // Fails unless only whitespace is left after the top-level value.
+    void expectEnd()
+    {
+        skipWhitespace();
+        if ( pos_ < in_.size() ) { fail("trailing data"); }
+    }
+
+    bool peekNull()
+    {
+        skipWhitespace();
+        if ( in_.substr(pos_, 4) == "null" ) { pos_ += 4; return true; }
+        return false;
+    }
+
+    // Steps over a string without unescaping it; escapes are not validated.
+    void skipString()
+    {
+        expect('"');
+        while ( pos_ < in_.size() and in_[pos_] != '"' ) { pos_ += in_[pos_] == '\\' ? 2 : 1; }
+        if ( pos_ >= in_.size() ) { fail("unterminated string"); }
+        ++pos_;
+    }
+
+    void skipValue()
+    {
+        skipWhitespace();
+        if ( pos_ >= in_.size() ) { fail("unexpected end of input"); }
+
+        std::string scratch;
+        switch ( in_[pos_] ) {
+            case '{':
+                beginObject();
+                while ( nextMember() ) { readKey(scratch); skipValue(); }
+                break;
+            case '[':
+                beginArray();
+                while ( nextElement() ) { skipValue(); }
+                break;
+            case '"': skipString(); break;
+            case 't': expectLiteral("true"); break;
+            case 'f': expectLiteral("false"); break;
+            case 'n': expectLiteral("null"); break;
+            default: scanNumber();
+        }
+    }
+};
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "json.hpp"
+#include "json_stream.hpp"
 #include <cstddef>
 #include <optional>
 #include <string_view>
@@ -13,34 +14,161 @@ namespace messages {
 
 struct TaskMessage {
     int taskId{0};
-    std::vector<int> sectionIds{};
+    int textId{0};
+    // The batch is sections [firstSection, lastSection] of the text;
+    // firstSection also orders the results.
+    int firstSection{0};
+    int lastSection{0};
     int totalSections{0};
     long startTime{0};
+    std::string tenant{};
+    int priority{0};
+    // Section contents in section order when the splitter pushed them;
+    // empty means the worker fetches the range itself.
+    std::vector<std::string> sections{};
+    // Set when a worker failed the batch and put it back; a batch that fails
+    // again is dropped.
+    bool retried{false};
 
     std::string toJson() const
     {
         nlohmann::json json;
         json["task_id"] = taskId;
         json["total_sections"] = totalSections;
-        json["section_ids"] = sectionIds;
+        json["text_id"] = textId;
+        json["first_section"] = firstSection;
+        json["last_section"] = lastSection;
         json["start_time"] = startTime;
+        json["tenant"] = tenant;
+        json["priority"] = priority;
+        if ( not sections.empty() ) { json["sections"] = sections; }
+        if ( retried ) { json["retried"] = true; }
 
         return json.dump();
     } 
     
-    static TaskMessage fromJson(const std::string& msg)
+    static TaskMessage fromJson(const std::string_view msg)
     {
         TaskMessage task;
         auto json = nlohmann::json::parse(msg);
         if ( json["task_id"].is_number() ) { task.taskId = json["task_id"]; }
         if ( json["total_sections"].is_number() ) { task.totalSections = json["total_sections"]; }
-        if ( json["section_ids"].is_array() ) { task.sectionIds = json["section_ids"].get<decltype(task.sectionIds)>(); }
+        if ( json["text_id"].is_number() ) { task.textId = json["text_id"]; }
+        if ( json["first_section"].is_number() ) { task.firstSection = json["first_section"]; }
+        if ( json["last_section"].is_number() ) { task.lastSection = json["last_section"]; }
         if ( json["start_time"].is_number() ) { task.startTime = json["start_time"]; }
+        if ( json["tenant"].is_string() ) { task.tenant = json["tenant"]; }
+        if ( json["priority"].is_number() ) { task.priority = json["priority"]; }
+        if ( json["sections"].is_array() ) { task.sections = json["sections"].get<decltype(task.sections)>(); }
+        if ( json["retried"].is_boolean() ) { task.retried = json["retried"]; }
         
         return task;
     }
+
+    // Only text_id, for routing: other members, pushed sections included,
+    // are skipped without being materialized.
+    static int textIdOf(const std::string_view msg)
+    {
+        json_stream::Reader json{msg};
+        std::string keyScratch;
+
+        json.beginObject();
+        while ( json.nextMember() ) {
+            auto key = json.readKey(keyScratch);
+            if ( json.peekNull() ) { continue; }
+            if ( key == "text_id" ) { return json.readInteger<int>(); }
+            json.skipValue();
+        }
+        return 0;
+    }
+};
+
+// Sent by a worker in pull mode to ask the scheduler for its next
+// assignment; a worker runs one at a time. The scheduler sizes each
+// assignment from the reported rate.
+struct WorkRequest {
+    std::string workerId{};
+    // Recent throughput; 0 until the worker has finished something.
+    double sectionsPerSecond{0};
+    // (taskId, firstSection) of assignments finished since the last request.
+    std::vector<std::pair<int, int>> completed{};
+
+    std::string toJson() const
+    {
+        nlohmann::json json;
+        json["worker_id"] = workerId;
+        json["sections_per_second"] = sectionsPerSecond;
+        json["completed"] = completed;
+
+        return json.dump();
+    }
+
+    static WorkRequest fromJson(const std::string_view msg)
+    {
+        WorkRequest request;
+        auto json = nlohmann::json::parse(msg);
+        if ( json["worker_id"].is_string() ) { request.workerId = json["worker_id"]; }
+        if ( json["sections_per_second"].is_number() ) { request.sectionsPerSecond = json["sections_per_second"]; }
+        if ( json["completed"].is_array() ) { request.completed = json["completed"].get<decltype(request.completed)>(); }
+
+        return request;
+    }
 };
 
+namespace detail {
+
+// Reads a string value into an owned string, stealing the unescape scratch
+// buffer instead of copying when the value had escapes.
+inline std::string readOwnedString(json_stream::Reader& json, std::string& scratch)
+{
+    auto text = json.readString(scratch);
+    if ( text.data() == scratch.data() ) { return std::move(scratch); }
+    return std::string(text);
+}
+
+// Reads an array of {"count": n, "text": "..."} objects. emit receives the
+// text as a view valid only during the call, plus whether it was unescaped
+// (i.e. does not point into the input).
+template <typename Emit>
+void readCountedTexts(json_stream::Reader& json, Emit&& emit)
+{
+    std::string keyScratch;
+    std::string scratch;
+
+    json.beginArray();
+    while ( json.nextElement() ) {
+        size_t count = 0;
+        std::string_view text;
+        bool unescaped = false;
+
+        json.beginObject();
+        while ( json.nextMember() ) {
+            auto key = json.readKey(keyScratch);
+            if ( key == "count" ) {
+                count = json.readInteger<size_t>();
+            } else if ( key == "text" ) {
+                text = json.readString(scratch);
+                unescaped = text.data() == scratch.data();
+            } else {
+                json.skipValue();
+            }
+        }
+        emit(count, text, unescaped);
+    }
+}
+
+template <typename Pairs>
+void writeCountedTexts(json_stream::Writer& json, std::string_view name, const Pairs& pairs)
+{
+    json.key(name).beginArray();
+    for ( const auto& [count, text] : pairs ) {
+        json.beginObject().field("count", count).field("text", text).endObject();
+    }
+    json.endArray();
+}
+
+}
+
 struct ResultMessage {
     int taskId{0};
     int sectionsCount{0};
@@ -54,64 +182,191 @@ struct ResultMessage {
     int tonality{0};
     std::string replacedText;
 
-    std::string toJson() const
+    // See ResultChunk.
+    int firstSection{0};
+    long streamId{0};
+    bool chunked{false};
+
+    // Sections whose results were lost. A worker or the scheduler reports a
+    // batch it gave up with every section failed and no content, so the
+    // task can still finish; a total with any is reported as failed.
+    int failedSections{0};
+
+    // Views into the payload this message was parsed from; only filled by
+    // fromJson with borrowWords set. Words that needed unescaping still land
+    // in topWords, so consumers have to look at both lists.
+    std::vector<std::pair<size_t, std::string_view>> topWordRefs;
+
+    void toJson(std::string& out) const
     {
-        nlohmann::json json;
+        out.clear();
+        json_stream::Writer json{out};
 
-        json["task_id"] = taskId;
-        json["sections_count"] = sectionsCount;
-        json["total_sections"] = totalSections;
-        json["start_time"] = startTime;
-        json["end_time"] = endTime;
+        json.beginObject()
+            .field("task_id", taskId)
+            .field("sections_count", sectionsCount)
+            .field("total_sections", totalSections)
+            .field("first_section", firstSection)
+            .field("start_time", startTime)
+            .field("end_time", endTime)
+            .field("words_count", wordsCount);
 
-        json["words_count"] = wordsCount;
+        json.key("top_words").beginArray();
+        for ( const auto& [count, text] : topWords ) {
+            json.beginObject().field("count", count).field("text", text).endObject();
+        }
+        for ( const auto& [count, text] : topWordRefs ) {
+            json.beginObject().field("count", count).field("text", text).endObject();
+        }
+        json.endArray();
 
-        json["top_words"] = nlohmann::json::array();
-        for (auto& p : topWords)
-            json["top_words"].push_back({ {"count", p.first}, {"text", p.second} });
+        detail::writeCountedTexts(json, "sorted_sentences", sortedSentences);
 
-        json["sorted_sentences"] = nlohmann::json::array();
-        for (auto& p : sortedSentences)
-            json["sorted_sentences"].push_back({ {"count", p.first}, {"text", p.second} });
+        json.field("tonality", tonality)
+            .field("replaced_text", replacedText);
 
-        json["tonality"] = tonality;
-        json["replaced_text"] = replacedText;
+        if ( chunked ) { json.field("stream_id", streamId).field("chunked", chunked); }
+        if ( failedSections > 0 ) { json.field("failed_sections", failedSections); }
 
-        return json.dump();
+        json.endObject();
     }
 
-    static ResultMessage fromJson(const std::string_view msg)
+    // The result reporting a batch as given up; see failedSections.
+    static ResultMessage failedBatch(const TaskMessage& task)
     {
-        auto json = nlohmann::json::parse(msg);
+        ResultMessage r;
+        r.taskId = task.taskId;
+        r.firstSection = task.firstSection;
+        r.sectionsCount = task.lastSection - task.firstSection + 1;
+        r.failedSections = r.sectionsCount;
+        r.totalSections = task.totalSections;
+        r.startTime = task.startTime;
+        return r;
+    }
+
+    std::string toJson() const
+    {
+        std::string out;
+        toJson(out);
+        return out;
+    }
 
+    // With borrowWords the top words are returned as views into msg, which
+    // must then outlive the message.
+    static ResultMessage fromJson(const std::string_view msg, bool borrowWords = false)
+    {
         ResultMessage r;
+        json_stream::Reader json{msg};
+        std::string keyScratch;
+        std::string scratch;
+
+        json.beginObject();
+        while ( json.nextMember() ) {
+            auto key = json.readKey(keyScratch);
+            if ( json.peekNull() ) { continue; }
+
+            if ( key == "task_id" ) { r.taskId = json.readInteger<int>(); }
+            else if ( key == "sections_count" ) { r.sectionsCount = json.readInteger<int>(); }
+            else if ( key == "total_sections" ) { r.totalSections = json.readInteger<int>(); }
+            else if ( key == "first_section" ) { r.firstSection = json.readInteger<int>(); }
+            else if ( key == "start_time" ) { r.startTime = json.readInteger<long>(); }
+            else if ( key == "end_time" ) { r.endTime = json.readInteger<long>(); }
+            else if ( key == "words_count" ) { r.wordsCount = json.readInteger<size_t>(); }
+            else if ( key == "tonality" ) { r.tonality = json.readInteger<int>(); }
+            else if ( key == "replaced_text" ) { r.replacedText = detail::readOwnedString(json, scratch); }
+            else if ( key == "stream_id" ) { r.streamId = json.readInteger<long>(); }
+            else if ( key == "chunked" ) { r.chunked = json.readBool(); }
+            else if ( key == "failed_sections" ) { r.failedSections = json.readInteger<int>(); }
+            else if ( key == "top_words" ) {
+                detail::readCountedTexts(json, [&](size_t count, std::string_view text, bool unescaped) {
+                    if ( borrowWords and not unescaped ) { r.topWordRefs.emplace_back(count, text); }
+                    else { r.topWords.emplace_back(count, std::string(text)); }
+                });
+            } else if ( key == "sorted_sentences" ) {
+                detail::readCountedTexts(json, [&](size_t count, std::string_view text, bool) {
+                    r.sortedSentences.emplace_back(count, std::string(text));
+                });
+            } else {
+                json.skipValue();
+            }
+        }
+        json.expectEnd();
 
-        r.taskId = json.value("task_id", 0);
-        r.sectionsCount = json.value("sections_count", 0);
-        r.totalSections = json.value("total_sections", 0);
-        r.startTime = json.value("start_time", 0L);
-        r.endTime = json.value("end_time", 0L);
+        return r;
+    }
+};
 
-        r.wordsCount = json.value("words_count", 0);
+// One part of a chunked result. A result whose sentences and text would make
+// an oversized message is sent as its head (ResultMessage with chunked set
+// and both left empty) followed by chunks of the same stream: sentence
+// chunks first, then text chunks, the final one marked last. Chunks of a
+// stream travel in publish order on one queue; receivers drop a repeated
+// seq, and a gap fails the stream's sections.
+struct ResultChunk {
+    int seq{0};
+    int taskId{0};
+    int firstSection{0};
+    long streamId{0};
+    bool last{false};
+    std::vector<std::pair<size_t, std::string>> sortedSentences;
+    std::string text;
 
-        if (json.contains("top_words"))
-            for (auto& j : json["top_words"])
-                r.topWords.emplace_back(
-                    j.value("count",0),
-                    j.value("text","")
-                );
+    // Chunks always open with this key, so a receiver can tell them from a
+    // head without parsing.
+    static constexpr std::string_view prefix = "{\"chunk\":";
 
-        if (json.contains("sorted_sentences"))
-            for (auto& j : json["sorted_sentences"])
-                r.sortedSentences.emplace_back(
-                    j.value("count",0),
-                    j.value("text","")
-                );
+    static bool isChunk(std::string_view msg)
+    {
+        return msg.substr(0, prefix.size()) == prefix;
+    }
 
-        r.tonality = json.value("tonality", 0);
-        r.replacedText = json.value("replaced_text", "");
+    void toJson(std::string& out) const
+    {
+        out.clear();
+        json_stream::Writer json{out};
 
-        return r;
+        json.beginObject()
+            .field("chunk", seq)
+            .field("task_id", taskId)
+            .field("first_section", firstSection)
+            .field("stream_id", streamId)
+            .field("last", last);
+
+        if ( not sortedSentences.empty() ) { detail::writeCountedTexts(json, "sorted_sentences", sortedSentences); }
+        if ( not text.empty() ) { json.field("text", text); }
+
+        json.endObject();
+    }
+
+    static ResultChunk fromJson(const std::string_view msg)
+    {
+        ResultChunk c;
+        json_stream::Reader json{msg};
+        std::string keyScratch;
+        std::string scratch;
+
+        json.beginObject();
+        while ( json.nextMember() ) {
+            auto key = json.readKey(keyScratch);
+            if ( json.peekNull() ) { continue; }
+
+            if ( key == "chunk" ) { c.seq = json.readInteger<int>(); }
+            else if ( key == "task_id" ) { c.taskId = json.readInteger<int>(); }
+            else if ( key == "first_section" ) { c.firstSection = json.readInteger<int>(); }
+            else if ( key == "stream_id" ) { c.streamId = json.readInteger<long>(); }
+            else if ( key == "last" ) { c.last = json.readBool(); }
+            else if ( key == "text" ) { c.text = detail::readOwnedString(json, scratch); }
+            else if ( key == "sorted_sentences" ) {
+                detail::readCountedTexts(json, [&](size_t count, std::string_view text, bool) {
+                    c.sortedSentences.emplace_back(count, std::string(text));
+                });
+            } else {
+                json.skipValue();
+            }
+        }
+        json.expectEnd();
+
+        return c;
     }
 };
 
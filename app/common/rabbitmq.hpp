@@ -3,19 +3,78 @@
 #include <amqp.h>
 #include <amqp_tcp_socket.h>
 #include <amqp_framing.h>
+#include <iostream>
 #include <string>
 
-class RabbitMQ {
+#include "compression.hpp"
+#include "transport.hpp"
+
+class RabbitMQ : public Transport {
 private:
     amqp_connection_state_t connection_{nullptr};
     amqp_socket_t* socket_{nullptr};
     amqp_bytes_t consumer_tag_{amqp_empty_bytes};
     bool is_connected_{false};
 
+    compression::Compressor compressor_;
+    compression::Codec codec_{compression::Codec::None};
+    size_t compressionThreshold_{0};
+    std::string compressed_;
+    uint16_t prefetch_{0};
+    bool deferredAck_{false};
+    uint64_t unacked_{0};
+
+    bool decodeBody(const amqp_message_t& received, std::string& message)
+    {
+        std::string_view body(static_cast<const char*>(received.body.bytes), received.body.len);
+
+        auto codec = compression::Codec::None;
+        const auto& props = received.properties;
+        if ( props._flags & AMQP_BASIC_CONTENT_ENCODING_FLAG ) {
+            codec = compression::codecFromName({static_cast<const char*>(props.content_encoding.bytes),
+                                                props.content_encoding.len});
+        }
+        return compressor_.decompress(codec, body, message);
+    }
+
+    // An undecodable payload is requeued once, so a consumer that can decode
+    // it (e.g. one built with the codec or holding the dictionary) may still
+    // take it. A second failure would repeat on every redelivery, so the
+    // message is dropped loudly then.
+    bool settle(uint64_t delivery_tag, bool decoded, bool redelivered)
+    {
+        if ( not decoded ) {
+            if ( redelivered ) {
+                std::cerr << "Error: Dropping a message that cannot be decoded" << std::endl;
+            }
+            amqp_basic_reject(connection_, 1, delivery_tag, redelivered ? 0 : 1);
+            return false;
+        }
+
+        if ( deferredAck_ ) {
+            unacked_ = delivery_tag;
+        } else {
+            amqp_basic_ack(connection_, 1, delivery_tag, 0);
+        }
+        return true;
+    }
+
+    // A passive declare only reports on an existing queue; declare it first,
+    // the broker closes the channel otherwise.
+    amqp_queue_declare_ok_t* declarePassive(const std::string& queueName)
+    {
+        if ( not is_connected_ ) { return nullptr; }
+
+        auto* ok = amqp_queue_declare(connection_, 1, amqp_cstring_bytes(queueName.c_str()),
+                                      1, 0, 0, 0, amqp_empty_table);
+        if ( amqp_get_rpc_reply(connection_).reply_type != AMQP_RESPONSE_NORMAL ) { return nullptr; }
+        return ok;
+    }
+
 public:
     RabbitMQ() = default;
     
-    ~RabbitMQ()
+    ~RabbitMQ() override
     {
         disconnect();
     }
@@ -90,7 +149,7 @@ public:
         return true;
     }
 
-    bool declareQueue(const std::string& queueName)
+    bool declareQueue(const std::string& queueName) override
     {
         if ( not is_connected_ ) { return false; }
 
@@ -101,7 +160,35 @@ public:
         return reply.reply_type == AMQP_RESPONSE_NORMAL;
     }
 
-    bool sendMessage(const std::string& message, const std::string& queueName)
+    // Exclusive and auto-deleted: the broker drops the queue, and anything
+    // still in it, when this connection goes away.
+    bool declareTemporaryQueue(const std::string& queueName) override
+    {
+        if ( not is_connected_ ) { return false; }
+
+        amqp_queue_declare(connection_, 1, amqp_cstring_bytes(queueName.c_str()),
+                          0, 0, 1, 1, amqp_empty_table);
+
+        amqp_rpc_reply_t reply = amqp_get_rpc_reply(connection_);
+        return reply.reply_type == AMQP_RESPONSE_NORMAL;
+    }
+
+    // Payloads of at least thresholdBytes are published compressed with the
+    // given codec and tagged through content-encoding. Receiving always
+    // decodes, so the dictionary (if any) is needed on both sides.
+    bool setCompression(const std::string& codecName, size_t thresholdBytes,
+                        const std::string& dictionaryPath = "")
+    {
+        auto codec = compression::codecFromName(codecName);
+        if ( not compression::isAvailable(codec) ) { return false; }
+        if ( not dictionaryPath.empty() and not compressor_.loadDictionary(dictionaryPath) ) { return false; }
+
+        codec_ = codec;
+        compressionThreshold_ = thresholdBytes;
+        return true;
+    }
+
+    bool sendMessage(const std::string& message, const std::string& queueName) override
     {
         if ( not is_connected_ ) { return false; }
 
@@ -109,16 +196,42 @@ public:
         message_bytes.len = message.size();
         message_bytes.bytes = const_cast<void*>(static_cast<const void*>(message.c_str()));
 
+        amqp_basic_properties_t props{};
+        const amqp_basic_properties_t* propsPtr = nullptr;
+        if ( codec_ != compression::Codec::None and message.size() >= compressionThreshold_ and
+             compressor_.compress(codec_, message, compressed_) and compressed_.size() < message.size() ) {
+            message_bytes.len = compressed_.size();
+            message_bytes.bytes = compressed_.data();
+
+            auto encoding = compression::codecName(codec_);
+            props._flags = AMQP_BASIC_CONTENT_ENCODING_FLAG;
+            props.content_encoding.len = encoding.size();
+            props.content_encoding.bytes = const_cast<char*>(encoding.data());
+            propsPtr = &props;
+        }
+
         int status = amqp_basic_publish(connection_, 1, amqp_empty_bytes, 
                                        amqp_cstring_bytes(queueName.c_str()),
-                                       0, 0, nullptr, message_bytes);
+                                       0, 0, propsPtr, message_bytes);
         return status == AMQP_STATUS_OK;
     }
 
-    bool startConsuming(const std::string& queueName)
+    // Caps unacknowledged deliveries per consumer; 0 leaves it unlimited.
+    // Takes effect on the next startConsuming.
+    void setPrefetch(uint16_t count)
+    {
+        prefetch_ = count;
+    }
+
+    bool startConsuming(const std::string& queueName) override
     {
         if ( not is_connected_ ) { return false; }
 
+        if ( prefetch_ > 0 ) {
+            amqp_basic_qos(connection_, 1, 0, prefetch_, 0);
+            if ( amqp_get_rpc_reply(connection_).reply_type != AMQP_RESPONSE_NORMAL ) { return false; }
+        }
+
         amqp_basic_consume_ok_t* consume_ok = amqp_basic_consume(connection_, 1, 
                                                                  amqp_cstring_bytes(queueName.c_str()),
                                                                  amqp_empty_bytes, 0, 0, 0, amqp_empty_table);
@@ -129,9 +242,22 @@ public:
         return true;
     }
 
-    bool receiveMessage(std::string& message, int timeout_sec = 1)
+    void setDeferredAck(bool deferred) override
+    {
+        deferredAck_ = deferred;
+    }
+
+    void acknowledge() override
+    {
+        if ( unacked_ == 0 or not is_connected_ ) { return; }
+        amqp_basic_ack(connection_, 1, unacked_, 0);
+        unacked_ = 0;
+    }
+
+    bool receiveMessage(std::string& message, int timeout_sec = 1) override
     {
         if ( not is_connected_ ) { return false; }
+        acknowledge();
 
         amqp_envelope_t envelope;
         amqp_maybe_release_buffers(connection_);
@@ -143,21 +269,54 @@ public:
         amqp_rpc_reply_t reply = amqp_consume_message(connection_, &envelope, &timeout, 0);
         
         if ( reply.reply_type == AMQP_RESPONSE_NORMAL ) {
-            message = std::string(static_cast<const char*>(envelope.message.body.bytes),
-                                 envelope.message.body.len);
-            
+            bool decoded = decodeBody(envelope.message, message);
             uint64_t delivery_tag = envelope.delivery_tag;
+            bool redelivered = envelope.redelivered;
             amqp_destroy_envelope(&envelope);
-            
-            amqp_basic_ack(connection_, 1, delivery_tag, 0);
-            return true;
+
+            return settle(delivery_tag, decoded, redelivered);
         } else if ( reply.reply_type == AMQP_RESPONSE_LIBRARY_EXCEPTION and
                     reply.library_error == AMQP_STATUS_TIMEOUT ) { return false; }
         
         return false;
     }
 
-    bool isConnected() const
+    bool getMessage(const std::string& queueName, std::string& message) override
+    {
+        if ( not is_connected_ ) { return false; }
+        acknowledge();
+
+        amqp_maybe_release_buffers(connection_);
+        amqp_rpc_reply_t reply = amqp_basic_get(connection_, 1, amqp_cstring_bytes(queueName.c_str()), 0);
+        if ( reply.reply_type != AMQP_RESPONSE_NORMAL or reply.reply.id != AMQP_BASIC_GET_OK_METHOD ) { return false; }
+
+        auto* ok = static_cast<amqp_basic_get_ok_t*>(reply.reply.decoded);
+        uint64_t delivery_tag = ok->delivery_tag;
+        bool redelivered = ok->redelivered;
+
+        amqp_message_t received;
+        reply = amqp_read_message(connection_, 1, &received, 0);
+        if ( reply.reply_type != AMQP_RESPONSE_NORMAL ) { return false; }
+
+        bool decoded = decodeBody(received, message);
+        amqp_destroy_message(&received);
+
+        return settle(delivery_tag, decoded, redelivered);
+    }
+
+    long messageCount(const std::string& queueName) override
+    {
+        auto* ok = declarePassive(queueName);
+        return ok ? static_cast<long>(ok->message_count) : -1;
+    }
+
+    long consumerCount(const std::string& queueName) override
+    {
+        auto* ok = declarePassive(queueName);
+        return ok ? static_cast<long>(ok->consumer_count) : -1;
+    }
+
+    bool isConnected() const override
     {
         return is_connected_;
     }
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <pqxx/pqxx>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "constants.hpp"
+
+// Final results keyed by (texts.content_hash, RESULT_CACHE_PARAMS). The
+// aggregator stores every completed result under the hash its task was
+// registered with; the splitter replays a stored one instead of publishing
+// batches. Texts without a content hash are never cached.
+namespace db {
+
+inline std::optional<std::string> cachedResult(pqxx::transaction_base& txn, int textId)
+{
+    auto result = txn.exec_params(
+        "SELECT r.payload FROM texts x "
+        "JOIN result_cache r ON r.content_hash = x.content_hash AND r.params = $2 "
+        "WHERE x.id = $1",
+        textId, RESULT_CACHE_PARAMS
+    );
+    if ( result.empty() ) { return std::nullopt; }
+    return result[0][0].as<std::string>();
+}
+
+// Keeps the first result stored for a content; later ones are identical.
+inline void storeResult(pqxx::connection& conn, int taskId, std::string_view payload)
+{
+    pqxx::nontransaction txn(conn);
+    txn.exec_params(
+        "INSERT INTO result_cache (content_hash, params, payload) "
+        "SELECT content_hash, $2, $3 FROM tasks WHERE id = $1 AND content_hash IS NOT NULL "
+        "ON CONFLICT DO NOTHING",
+        taskId, RESULT_CACHE_PARAMS, payload
+    );
+}
+
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "constants.hpp"
+#include "messages.hpp"
+
+// Maps work onto queues. Routing goes through the default exchange, which
+// is a direct exchange keyed by queue name, so every transport backend
+// supports it.
+namespace routing {
+
+inline uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+// All results of a task land on the same shard, so its state stays local to
+// one aggregator instance.
+inline int resultShard(int taskId)
+{
+    return static_cast<int>(mix(static_cast<uint64_t>(taskId)) % RESULT_SHARDS);
+}
+
+inline std::string resultsQueueName(int shard)
+{
+    if ( RESULT_SHARDS == 1 ) { return RESULTS_QUEUE_NAME; }
+    return RESULTS_QUEUE_NAME + "." + std::to_string(shard);
+}
+
+inline std::string resultsQueueFor(int taskId)
+{
+    return resultsQueueName(resultShard(taskId));
+}
+
+// FNV-1a, stable across processes unlike std::hash.
+inline uint64_t hashString(std::string_view str)
+{
+    uint64_t h = 0xcbf29ce484222325;
+    for ( unsigned char c : str ) {
+        h = (h ^ c) * 0x100000001b3;
+    }
+    return h;
+}
+
+inline std::string laneQueueName(int lane)
+{
+    return LANE_QUEUE_PREFIX + std::to_string(lane);
+}
+
+// Where the splitter publishes a task batch: straight to the workers, or to
+// the scheduler lane of its tenant (the priority lane for interactive tasks).
+inline std::string submitQueueFor(const messages::TaskMessage& task)
+{
+    if ( not SCHEDULER_ENABLED ) { return QUEUE_NAME; }
+    if ( task.priority > 0 ) { return PRIORITY_QUEUE_NAME; }
+    return laneQueueName(static_cast<int>(hashString(task.tenant) % TENANT_LANES));
+}
+
+// Private queue a worker receives its assignments on in pull mode.
+inline std::string workerQueueName(const std::string& workerId)
+{
+    return WORKER_QUEUE_PREFIX + workerId;
+}
+
+inline std::string groupQueueName(int group)
+{
+    return GROUP_QUEUE_PREFIX + std::to_string(group);
+}
+
+// Consistent-hash ring over the worker groups. Each group owns
+// GROUP_VIRTUAL_NODES points, so changing WORKER_GROUPS only moves the texts
+// on the arcs that changed hands.
+class AffinityRing {
+private:
+    std::vector<std::pair<uint64_t, int>> points_;
+
+public:
+    explicit AffinityRing(int groups)
+    {
+        for ( int group = 0; group < groups; ++group ) {
+            for ( int node = 0; node < GROUP_VIRTUAL_NODES; ++node ) {
+                points_.emplace_back(mix(mix(static_cast<uint64_t>(group) + 1) + node), group);
+            }
+        }
+        std::sort(points_.begin(), points_.end());
+    }
+
+    int groupFor(int textId) const
+    {
+        auto it = std::lower_bound(points_.begin(), points_.end(),
+                                   std::make_pair(mix(static_cast<uint64_t>(textId)), INT_MIN));
+        if ( it == points_.end() ) { it = points_.begin(); }
+        return it->second;
+    }
+};
+
+// Group of a worker that was not given one: all workers of a host share a
+// group, and with it the host's section cache.
+inline int hostGroup()
+{
+    char host[64] = {};
+    gethostname(host, sizeof(host) - 1);
+    return static_cast<int>(hashString(host) % std::max(WORKER_GROUPS, 1));
+}
+
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace shm {
+
+// Host-wide cache of section contents in a POSIX shared-memory segment, so
+// every worker process on the host shares what any of them fetched. Entries
+// are addressed by content hash, which no reload can reuse for other
+// bytes, so nothing ever has to be invalidated. Slots
+// have a fixed size and are grouped into sets of `ways`; a key maps to one
+// set and evicts within it by CLOCK. Reads take no lock: each slot is a
+// seqlock, and a read that overlaps a write sees the sequence move and
+// counts as a miss. Writers claim a slot by making its sequence odd and
+// skip the insert when another writer holds it.
+class SectionCache {
+private:
+    static constexpr uint64_t magic = 0x7365637463616368;  // "sectcach"
+    static constexpr uint32_t ways = 8;
+    static constexpr size_t cacheLine = 64;
+
+    struct alignas(cacheLine) Header {
+        uint64_t magic;
+        uint64_t sets;
+        uint64_t slotBytes;
+        std::atomic<uint32_t> ready;
+    };
+
+    // Content follows the slot header. Key 0 never occurs, so zeroed slots
+    // of a fresh segment are empty. key and version together hold 128 bits
+    // of the content hash.
+    struct Slot {
+        std::atomic<uint32_t> seq;
+        std::atomic<uint32_t> referenced;
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> version;
+        std::atomic<uint32_t> length;
+    };
+
+    Header* header_{nullptr};
+    std::atomic<uint32_t>* hands_{nullptr};
+    char* slots_{nullptr};
+    size_t mappedSize_{0};
+    size_t slotBytes_{0};
+    size_t stride_{0};
+    uint64_t sets_{0};
+
+    static size_t alignUp(size_t size)
+    {
+        return (size + cacheLine - 1) & ~(cacheLine - 1);
+    }
+
+    static size_t handsSize(uint64_t sets)
+    {
+        return alignUp(sets * sizeof(std::atomic<uint32_t>));
+    }
+
+    uint64_t setFor(uint64_t key) const
+    {
+        // Fibonacci hashing mixes the key's high bits into the set index.
+        return (key * 0x9E3779B97F4A7C15ull >> 16) % sets_;
+    }
+
+    Slot& slotAt(uint64_t set, uint32_t way) const
+    {
+        return *reinterpret_cast<Slot*>(slots_ + (set * ways + way) * stride_);
+    }
+
+    static char* content(Slot& slot)
+    {
+        return reinterpret_cast<char*>(&slot) + sizeof(Slot);
+    }
+
+public:
+    SectionCache() = default;
+
+    ~SectionCache()
+    {
+        if ( header_ ) { munmap(header_, mappedSize_); }
+    }
+
+    SectionCache(const SectionCache&) = delete;
+    SectionCache& operator=(const SectionCache&) = delete;
+
+    struct Id {
+        uint64_t key;
+        uint64_t version;
+    };
+
+    // The first 16 bytes of a content hash of at least that size.
+    static Id idOf(std::string_view hash)
+    {
+        Id id{};
+        std::memcpy(&id.key, hash.data(), sizeof(id.key));
+        std::memcpy(&id.version, hash.data() + sizeof(id.key), sizeof(id.version));
+        if ( id.key == 0 ) { id.key = 1; }
+        return id;
+    }
+
+    // Creates the segment with about `bytes` of slots or attaches to an
+    // existing one. Attaching fails if the segment was laid out for a
+    // different slot size.
+    bool open(const std::string& name, size_t bytes, size_t slotBytes)
+    {
+        size_t stride = alignUp(sizeof(Slot) + slotBytes);
+        uint64_t sets = std::max<uint64_t>(1, bytes / (stride * ways));
+        size_t size = sizeof(Header) + handsSize(sets) + sets * ways * stride;
+        bool created = true;
+
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+        if ( fd < 0 and errno == EEXIST ) {
+            created = false;
+            fd = shm_open(name.c_str(), O_RDWR, 0660);
+        }
+        if ( fd < 0 ) { return false; }
+
+        if ( created ) {
+            if ( ftruncate(fd, size) != 0 ) {
+                close(fd);
+                shm_unlink(name.c_str());
+                return false;
+            }
+        } else {
+            // The creator may not have sized the segment yet.
+            struct stat st{};
+            for ( int i = 0; i < 1000 and fstat(fd, &st) == 0 and static_cast<size_t>(st.st_size) < sizeof(Header); ++i ) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if ( static_cast<size_t>(st.st_size) < sizeof(Header) ) {
+                close(fd);
+                return false;
+            }
+            size = st.st_size;
+        }
+
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if ( addr == MAP_FAILED ) { return false; }
+
+        header_ = static_cast<Header*>(addr);
+        mappedSize_ = size;
+
+        if ( created ) {
+            header_->magic = magic;
+            header_->sets = sets;
+            header_->slotBytes = slotBytes;
+            header_->ready.store(1);
+        } else {
+            for ( int i = 0; i < 1000 and not header_->ready.load(); ++i ) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if ( not header_->ready.load() or header_->magic != magic or header_->slotBytes != slotBytes ) {
+                return false;
+            }
+            sets = header_->sets;
+            if ( sizeof(Header) + handsSize(sets) + sets * ways * stride > size ) { return false; }
+        }
+
+        sets_ = sets;
+        slotBytes_ = slotBytes;
+        stride_ = stride;
+        hands_ = reinterpret_cast<std::atomic<uint32_t>*>(static_cast<char*>(addr) + sizeof(Header));
+        slots_ = static_cast<char*>(addr) + sizeof(Header) + handsSize(sets);
+        return true;
+    }
+
+    // Appends the cached content to output on a hit.
+    bool get(uint64_t key, uint64_t version, std::string& output) const
+    {
+        uint64_t set = setFor(key);
+        for ( uint32_t way = 0; way < ways; ++way ) {
+            Slot& slot = slotAt(set, way);
+
+            uint32_t before = slot.seq.load(std::memory_order_acquire);
+            if ( before & 1 ) { continue; }
+            if ( slot.key.load(std::memory_order_relaxed) != key ) { continue; }
+            if ( slot.version.load(std::memory_order_relaxed) != version ) { continue; }
+
+            uint32_t length = slot.length.load(std::memory_order_relaxed);
+            if ( length > slotBytes_ ) { continue; }
+
+            size_t offset = output.size();
+            output.resize(offset + length);
+            std::memcpy(output.data() + offset, content(slot), length);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if ( slot.seq.load(std::memory_order_relaxed) != before ) {
+                output.resize(offset);
+                return false;
+            }
+
+            if ( not slot.referenced.load(std::memory_order_relaxed) ) {
+                slot.referenced.store(1, std::memory_order_relaxed);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Best effort: content larger than a slot, or a set busy with other
+    // writers, is simply not cached.
+    void put(uint64_t key, uint64_t version, std::string_view data)
+    {
+        if ( data.size() > slotBytes_ ) { return; }
+
+        uint64_t set = setFor(key);
+        for ( uint32_t way = 0; way < ways; ++way ) {
+            Slot& slot = slotAt(set, way);
+            if ( slot.key.load(std::memory_order_relaxed) == key and
+                 slot.version.load(std::memory_order_relaxed) == version ) {
+                return;
+            }
+        }
+
+        // CLOCK: referenced slots get a second chance, so two sweeps
+        // always reach a victim unless every slot is being written.
+        auto& hand = hands_[set];
+        for ( uint32_t step = 0; step < 2 * ways; ++step ) {
+            Slot& slot = slotAt(set, hand.fetch_add(1, std::memory_order_relaxed) % ways);
+            if ( slot.referenced.exchange(0, std::memory_order_relaxed) ) { continue; }
+
+            uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+            if ( seq & 1 ) { continue; }
+            if ( not slot.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_relaxed) ) { continue; }
+            std::atomic_thread_fence(std::memory_order_release);
+
+            slot.key.store(key, std::memory_order_relaxed);
+            slot.version.store(version, std::memory_order_relaxed);
+            slot.length.store(data.size(), std::memory_order_relaxed);
+            std::memcpy(content(slot), data.data(), data.size());
+
+            slot.seq.store(seq + 2, std::memory_order_release);
+            return;
+        }
+    }
+};
+
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <pqxx/pqxx>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "compression.hpp"
+#include "constants.hpp"
+#include "section_cache.hpp"
+#include "text.hpp"
+
+// Section storage shared by the stages that read texts from Postgres.
+// Sections of a text are numbered 1..texts.section_count, so a batch is a
+// [first, last] range served by the (text_id, section_number) unique index.
+// Sections point at section_contents by content hash; a content row holds
+// either plain text or, for sections first loaded compressed, a zstd frame
+// of it in packed.
+namespace db {
+
+inline const std::string SECTION_RANGE_QUERY =
+    "SELECT c.content, c.packed FROM sections s JOIN section_contents c ON c.hash = s.content_hash "
+    "WHERE s.text_id = $1 AND s.section_number BETWEEN $2 AND $3 "
+    "ORDER BY s.section_number";
+
+using Bytes = std::basic_string<std::byte>;
+
+inline std::string_view asChars(const Bytes& bytes)
+{
+    return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+}
+
+// Appends the text of one row to output.
+inline void unpackSection(compression::Compressor& compressor, const pqxx::row& row, std::string& output)
+{
+    if ( not row[1].is_null() ) {
+        auto packed = row[1].as<Bytes>();
+        if ( not compressor.decompressAppend(compression::Codec::Zstd, asChars(packed), output) ) {
+            throw std::runtime_error("Cannot decompress section");
+        }
+        return;
+    }
+
+    auto content = row[0].view();
+    output.append(content.data(), content.size());
+}
+
+// Compressor set up to read packed sections: frames written with the
+// shared dictionary need it to decompress.
+inline compression::Compressor sectionCompressor()
+{
+    compression::Compressor compressor;
+    if ( not COMPRESSION_DICTIONARY_PATH.empty() ) { compressor.loadDictionary(COMPRESSION_DICTIONARY_PATH); }
+    return compressor;
+}
+
+// Callers keep one compressor per thread: setting one up reads the
+// dictionary from disk.
+inline std::vector<std::string> getSectionRange(pqxx::transaction_base& txn, compression::Compressor& compressor,
+                                                int textId, int firstSection, int lastSection)
+{
+    auto result = txn.exec_params(SECTION_RANGE_QUERY, textId, firstSection, lastSection);
+
+    std::vector<std::string> sections;
+    sections.reserve(result.size());
+
+    for ( const auto& row : result ) {
+        unpackSection(compressor, row, sections.emplace_back());
+    }
+
+    return sections;
+}
+
+// The range with each section's stored partials, NULL where
+// `loader --stats` has not run yet, and content hash.
+inline const std::string SECTION_RANGE_WITH_STATS_QUERY =
+    "SELECT c.content, c.packed, st.words_count, st.positive_count, st.negative_count, "
+    "st.tokens, st.sentence_spans, s.content_hash "
+    "FROM sections s JOIN section_contents c ON c.hash = s.content_hash "
+    "LEFT JOIN section_stats st ON st.content_hash = s.content_hash "
+    "WHERE s.text_id = $1 AND s.section_number BETWEEN $2 AND $3 "
+    "ORDER BY s.section_number";
+
+// The same without the contents, for a reader that looks them up in the
+// host cache first.
+inline const std::string SECTION_HASHES_WITH_STATS_QUERY =
+    "SELECT NULL, NULL, st.words_count, st.positive_count, st.negative_count, "
+    "st.tokens, st.sentence_spans, s.content_hash "
+    "FROM sections s LEFT JOIN section_stats st ON st.content_hash = s.content_hash "
+    "WHERE s.text_id = $1 AND s.section_number BETWEEN $2 AND $3 "
+    "ORDER BY s.section_number";
+
+// Worker-side reader. The range query is prepared once per connection and
+// every fetch runs in one long-lived nontransaction, so a batch costs a
+// single round trip without BEGIN/COMMIT. Plain rows stay in the held
+// result and packed ones are decompressed back to back into one reused
+// buffer; both are handed out as views, valid until the next fetch.
+//
+// Stored partials come along in the same round trip and are handed out
+// when every section of the batch has them.
+//
+// With a host cache, the range's content hashes and partials are read
+// first and contents come from the cache by hash; only a batch with any
+// section missing reads its contents from Postgres. Hashes are read for
+// every batch, so a text reloaded meanwhile is never served stale.
+class SectionReader {
+private:
+    static constexpr const char* statement = "section_range";
+    static constexpr const char* hashStatement = "section_hashes";
+
+    std::optional<pqxx::nontransaction> txn_;
+    pqxx::result rows_;
+    compression::Compressor compressor_{sectionCompressor()};
+    std::string unpacked_;
+    std::vector<std::pair<size_t, size_t>> slices_;  // (section index, offset in unpacked_)
+    shm::SectionCache* cache_;
+
+    static shm::SectionCache::Id cacheId(const pqxx::row& row)
+    {
+        return shm::SectionCache::idOf(asChars(row[7].as<Bytes>()));
+    }
+
+    // Partials are handed out only when every section of the batch has them.
+    static void readStats(const pqxx::result& rows, std::vector<text::SectionStats>& stats)
+    {
+        stats.reserve(rows.size());
+        for ( const auto& row : rows ) {
+            if ( row[2].is_null() ) {
+                stats.clear();
+                return;
+            }
+            stats.push_back({row[2].as<size_t>(), row[3].as<int>(), row[4].as<int>(), row[5].view(), row[6].view()});
+        }
+    }
+
+    // Points the sections recorded in slices_ at their bytes in unpacked_,
+    // once it has stopped growing.
+    void bindSlices(std::vector<std::string_view>& sections) const
+    {
+        for ( size_t i = 0; i < slices_.size(); ++i ) {
+            auto [index, offset] = slices_[i];
+            size_t end = i + 1 < slices_.size() ? slices_[i + 1].second : unpacked_.size();
+            sections[index] = std::string_view(unpacked_).substr(offset, end - offset);
+        }
+    }
+
+    // All or nothing: a batch with any section missing is read as a whole.
+    bool fetchCached(int textId, int firstSection, int lastSection, std::vector<std::string_view>& sections,
+                     std::vector<text::SectionStats>& stats)
+    {
+        rows_ = txn_->exec_prepared(hashStatement, textId, firstSection, lastSection);
+        for ( const auto& row : rows_ ) {
+            auto id = cacheId(row);
+            slices_.emplace_back(slices_.size(), unpacked_.size());
+            if ( not cache_->get(id.key, id.version, unpacked_) ) {
+                unpacked_.clear();
+                slices_.clear();
+                return false;
+            }
+        }
+
+        sections.resize(slices_.size());
+        bindSlices(sections);
+        readStats(rows_, stats);
+        return true;
+    }
+
+public:
+    explicit SectionReader(pqxx::connection& conn, shm::SectionCache* cache = nullptr) : cache_(cache)
+    {
+        conn.prepare(statement, SECTION_RANGE_WITH_STATS_QUERY);
+        if ( cache_ ) { conn.prepare(hashStatement, SECTION_HASHES_WITH_STATS_QUERY); }
+        txn_.emplace(conn);
+    }
+
+    void fetch(int textId, int firstSection, int lastSection, std::vector<std::string_view>& sections,
+               std::vector<text::SectionStats>& stats)
+    {
+        sections.clear();
+        stats.clear();
+        unpacked_.clear();
+        slices_.clear();
+
+        if ( cache_ and fetchCached(textId, firstSection, lastSection, sections, stats) ) { return; }
+
+        rows_ = txn_->exec_prepared(statement, textId, firstSection, lastSection);
+        sections.reserve(rows_.size());
+
+        for ( const auto& row : rows_ ) {
+            if ( row[1].is_null() ) {
+                sections.push_back(row[0].view());
+                continue;
+            }
+
+            slices_.emplace_back(sections.size(), unpacked_.size());
+            unpackSection(compressor_, row, unpacked_);
+            sections.emplace_back();
+        }
+        bindSlices(sections);
+        readStats(rows_, stats);
+
+        if ( not cache_ ) { return; }
+
+        for ( size_t i = 0; i < sections.size(); ++i ) {
+            auto id = cacheId(rows_[i]);
+            cache_->put(id.key, id.version, sections[i]);
+        }
+    }
+};
+
+}
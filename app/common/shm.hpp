@@ -0,0 +1,415 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/futex.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "transport.hpp"
+
+namespace shm {
+
+inline void futexWait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::milliseconds timeout)
+{
+    timespec ts{};
+    ts.tv_sec = timeout.count() / 1000;
+    ts.tv_nsec = (timeout.count() % 1000) * 1'000'000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+inline void futexWake(std::atomic<uint32_t>& word, int count)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+// Multi-producer/single-consumer ring of variable-length records living in a
+// POSIX shared-memory segment. Producers reserve space with a CAS on the tail
+// and commit each record by publishing its start position in the record
+// header; the consumer reads records in place and releases them in order.
+// Sleeping on either side goes through futexes on sequence counters.
+//
+// A consumer that shuts down leaves a ring holding records in place, so the
+// next one attaches by name and carries on where it stopped; only an empty
+// ring is retired and unlinked. Producers that see it retired drop their
+// mapping and open the queue again, which creates a fresh segment.
+class Ring {
+private:
+    static constexpr uint64_t magic = 0x7465787470726f63;  // "textproc"
+    static constexpr size_t align = 16;
+    static constexpr uint32_t paddingFlag = 1;
+
+    // Header::state. A consumer shutting down holds the ring closing while
+    // it checks for records left; producers wait that out.
+    static constexpr uint32_t stateOpen = 0;
+    static constexpr uint32_t stateClosing = 1;
+    static constexpr uint32_t stateRetired = 2;
+
+    struct alignas(64) Header {
+        uint64_t magic;
+        uint64_t capacity;
+        std::atomic<uint32_t> ready;
+        alignas(64) std::atomic<uint64_t> tail;
+        alignas(64) std::atomic<uint64_t> head;
+        alignas(64) std::atomic<uint32_t> dataSeq;
+        std::atomic<uint32_t> consumerWaiting;
+        alignas(64) std::atomic<uint32_t> spaceSeq;
+        std::atomic<uint32_t> producersWaiting;
+        std::atomic<uint32_t> state;
+    };
+
+    // commit holds start position + 1 once the record is written; stale
+    // bytes left by older laps never match the position being read.
+    struct Record {
+        std::atomic<uint64_t> commit;
+        uint32_t length;
+        uint32_t flags;
+    };
+
+    Header* header_{nullptr};
+    char* data_{nullptr};
+    size_t mappedSize_{0};
+    uint64_t mask_{0};
+    size_t pendingRelease_{0};
+
+    static size_t recordSize(size_t length)
+    {
+        return (sizeof(Record) + length + align - 1) & ~(align - 1);
+    }
+
+    Record& recordAt(uint64_t pos) const
+    {
+        return *reinterpret_cast<Record*>(data_ + (pos & mask_));
+    }
+
+    void waitForSpace(uint64_t seenHead)
+    {
+        uint32_t seq = header_->spaceSeq.load();
+        header_->producersWaiting.fetch_add(1);
+        if ( header_->head.load() == seenHead ) {
+            futexWait(header_->spaceSeq, seq, std::chrono::milliseconds(10));
+        }
+        header_->producersWaiting.fetch_sub(1);
+    }
+
+    uint32_t settledState() const
+    {
+        uint32_t state;
+        while ( (state = header_->state.load()) == stateClosing ) { std::this_thread::yield(); }
+        return state;
+    }
+
+    void advanceHead(uint64_t head, size_t size)
+    {
+        recordAt(head).commit.store(0, std::memory_order_relaxed);
+        header_->head.store(head + size);
+        header_->spaceSeq.fetch_add(1);
+        if ( header_->producersWaiting.load() ) { futexWake(header_->spaceSeq, INT32_MAX); }
+    }
+
+public:
+    Ring() = default;
+
+    ~Ring()
+    {
+        if ( header_ ) { munmap(header_, mappedSize_); }
+    }
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    // Creates the segment or attaches to an existing one. Capacity must be a
+    // power of two and is ignored when attaching.
+    bool open(const std::string& name, size_t capacity)
+    {
+        size_t size = sizeof(Header) + capacity;
+        bool created = true;
+
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+        if ( fd < 0 and errno == EEXIST ) {
+            created = false;
+            fd = shm_open(name.c_str(), O_RDWR, 0660);
+        }
+        if ( fd < 0 ) { return false; }
+
+        if ( created ) {
+            if ( ftruncate(fd, size) != 0 ) {
+                close(fd);
+                shm_unlink(name.c_str());
+                return false;
+            }
+        } else {
+            // The creator may not have sized the segment yet.
+            struct stat st{};
+            for ( int i = 0; i < 1000 and fstat(fd, &st) == 0 and static_cast<size_t>(st.st_size) < sizeof(Header); ++i ) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if ( static_cast<size_t>(st.st_size) < sizeof(Header) ) {
+                close(fd);
+                return false;
+            }
+            size = st.st_size;
+        }
+
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if ( addr == MAP_FAILED ) { return false; }
+
+        header_ = static_cast<Header*>(addr);
+        data_ = static_cast<char*>(addr) + sizeof(Header);
+        mappedSize_ = size;
+
+        if ( created ) {
+            header_->magic = magic;
+            header_->capacity = capacity;
+            header_->ready.store(1);
+        } else {
+            for ( int i = 0; i < 1000 and not header_->ready.load(); ++i ) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if ( not header_->ready.load() or header_->magic != magic ) { return false; }
+        }
+
+        mask_ = header_->capacity - 1;
+        return true;
+    }
+
+    // Largest message push accepts.
+    size_t maxMessageBytes() const
+    {
+        return (mask_ + 1) / 2 - sizeof(Record);
+    }
+
+    bool retired() const
+    {
+        return header_->state.load() == stateRetired;
+    }
+
+    // Copies message into the ring once; blocks while the ring is full.
+    // Fails for messages over maxMessageBytes and once the ring is retired,
+    // including when that happened before the message could be read.
+    bool push(std::string_view message)
+    {
+        size_t need = recordSize(message.size());
+        size_t capacity = mask_ + 1;
+        if ( need > capacity / 2 ) { return false; }
+
+        uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+        uint64_t start;
+        for ( ;; ) {
+            if ( settledState() == stateRetired ) { return false; }
+
+            size_t contiguous = capacity - (tail & mask_);
+            size_t total = need <= contiguous ? need : contiguous + need;
+
+            uint64_t head = header_->head.load(std::memory_order_acquire);
+            if ( tail + total - head > capacity ) {
+                waitForSpace(head);
+                tail = header_->tail.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if ( header_->tail.compare_exchange_weak(tail, tail + total) ) {
+                if ( total != need ) {
+                    auto& padding = recordAt(tail);
+                    padding.length = contiguous - sizeof(Record);
+                    padding.flags = paddingFlag;
+                    padding.commit.store(tail + 1, std::memory_order_release);
+                }
+                start = tail + (total - need);
+                break;
+            }
+        }
+
+        auto& record = recordAt(start);
+        record.length = message.size();
+        record.flags = 0;
+        std::memcpy(data_ + (start & mask_) + sizeof(Record), message.data(), message.size());
+        record.commit.store(start + 1, std::memory_order_release);
+
+        header_->dataSeq.fetch_add(1);
+        if ( header_->consumerWaiting.load() ) { futexWake(header_->dataSeq, 1); }
+
+        // The reservation is ordered against retireIfEmpty's look at the
+        // tail: a consumer that missed it retired the ring, and the record
+        // is gone with the segment.
+        return settledState() != stateRetired;
+    }
+
+    // Returns the next record in place. It stays valid until the next call
+    // to peek or release. Only one consumer per ring.
+    bool peek(std::string_view& message, std::chrono::milliseconds timeout)
+    {
+        release();
+
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        for ( ;; ) {
+            uint64_t head = header_->head.load(std::memory_order_relaxed);
+            auto& record = recordAt(head);
+
+            if ( record.commit.load(std::memory_order_acquire) == head + 1 ) {
+                if ( record.flags & paddingFlag ) {
+                    advanceHead(head, sizeof(Record) + record.length);
+                    continue;
+                }
+
+                message = std::string_view(data_ + (head & mask_) + sizeof(Record), record.length);
+                pendingRelease_ = recordSize(record.length);
+                return true;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if ( now >= deadline ) { return false; }
+
+            uint32_t seq = header_->dataSeq.load();
+            header_->consumerWaiting.store(1);
+            if ( record.commit.load() != head + 1 ) {
+                futexWait(header_->dataSeq, seq,
+                          std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) +
+                          std::chrono::milliseconds(1));
+            }
+            header_->consumerWaiting.store(0);
+        }
+    }
+
+    void release()
+    {
+        if ( pendingRelease_ == 0 ) { return; }
+
+        advanceHead(header_->head.load(std::memory_order_relaxed), pendingRelease_);
+        pendingRelease_ = 0;
+    }
+
+    // Called by the consumer on shutdown, after it is done with the last
+    // record it peeked. Retires the ring and returns true if nothing is left
+    // in it, so the caller can unlink it; otherwise the ring stays open for
+    // the next consumer.
+    bool retireIfEmpty()
+    {
+        release();
+
+        header_->state.store(stateClosing);
+        bool empty = header_->tail.load() == header_->head.load();
+        header_->state.store(empty ? stateRetired : stateOpen);
+
+        header_->spaceSeq.fetch_add(1);
+        futexWake(header_->spaceSeq, INT32_MAX);
+        return empty;
+    }
+};
+
+}
+
+// Transport over shared-memory rings, one segment per queue, for stages that
+// share a host. Each queue has at most one consumer.
+class ShmTransport : public Transport {
+private:
+    size_t capacity_;
+    std::unordered_map<std::string, std::unique_ptr<shm::Ring>> rings_;
+    shm::Ring* consumed_{nullptr};
+    std::string consumedName_;
+
+    static std::string segmentName(const std::string& queueName)
+    {
+        return "/textproc." + queueName;
+    }
+
+    shm::Ring* lookup(const std::string& queueName)
+    {
+        if ( auto it = rings_.find(queueName); it != rings_.end() ) {
+            if ( it->second.get() == consumed_ or not it->second->retired() ) { return it->second.get(); }
+            rings_.erase(it);
+        }
+
+        auto ring = std::make_unique<shm::Ring>();
+        if ( not ring->open(segmentName(queueName), capacity_) ) { return nullptr; }
+        return (rings_[queueName] = std::move(ring)).get();
+    }
+
+public:
+    // Capacity is in bytes and must be a power of two.
+    explicit ShmTransport(size_t capacity) : capacity_(capacity) {}
+
+    ~ShmTransport() override
+    {
+        if ( not consumed_ ) { return; }
+        if ( consumed_->retireIfEmpty() ) {
+            shm_unlink(segmentName(consumedName_).c_str());
+        } else {
+            std::cout << "Leaving unread messages of " << consumedName_ << " for the next consumer." << std::endl;
+        }
+    }
+
+    ShmTransport(const ShmTransport&) = delete;
+    ShmTransport& operator=(const ShmTransport&) = delete;
+
+    bool declareQueue(const std::string& queueName) override
+    {
+        return lookup(queueName) != nullptr;
+    }
+
+    // Blocks while the ring is full. A message too large for the ring can't
+    // go through at all, which is reported rather than dropped quietly.
+    bool sendMessage(const std::string& message, const std::string& queueName) override
+    {
+        // A ring retired while we waited is retried once on its successor.
+        for ( int attempt = 0; attempt < 2; ++attempt ) {
+            auto* ring = lookup(queueName);
+            if ( not ring ) { return false; }
+
+            if ( message.size() > ring->maxMessageBytes() ) {
+                std::cerr << "Error: " << message.size() << " byte message exceeds the shared-memory ring of "
+                          << queueName << " (" << ring->maxMessageBytes() << " bytes max)" << std::endl;
+                return false;
+            }
+
+            if ( ring->push(message) ) { return true; }
+        }
+        return false;
+    }
+
+    bool startConsuming(const std::string& queueName) override
+    {
+        consumed_ = lookup(queueName);
+        consumedName_ = queueName;
+        return consumed_ != nullptr;
+    }
+
+    bool receiveMessage(std::string& message, int timeout_sec = 1) override
+    {
+        std::string_view view;
+        if ( not receiveView(view, timeout_sec) ) { return false; }
+
+        message.assign(view.data(), view.size());
+        consumed_->release();
+        return true;
+    }
+
+    bool receiveView(std::string_view& message, int timeout_sec = 1) override
+    {
+        return consumed_ and consumed_->peek(message, std::chrono::seconds(timeout_sec));
+    }
+
+    bool deliversInPlace() const override
+    {
+        return true;
+    }
+
+    bool isConnected() const override
+    {
+        return true;
+    }
+};
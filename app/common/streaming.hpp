@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "constants.hpp"
+#include "messages.hpp"
+#include "transport.hpp"
+
+namespace streaming {
+
+inline long newStreamId()
+{
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+    // Kept within 62 bits so it survives any JSON reader as an integer.
+    return static_cast<long>(generator() >> 2);
+}
+
+// Largest cut at or before limit that does not split a UTF-8 sequence.
+inline size_t utf8Cut(std::string_view text, size_t limit)
+{
+    if ( limit >= text.size() ) { return text.size(); }
+
+    size_t cut = limit;
+    while ( cut > 0 and (static_cast<unsigned char>(text[cut]) & 0xC0) == 0x80 ) { --cut; }
+    return cut > 0 ? cut : limit;
+}
+
+// Publishes result as one message, or as a head plus RESULT_CHUNK_BYTES
+// sized chunks when its sentences and text would exceed that. Sentences and
+// text are consumed from result in the chunked case. Returns false as soon as
+// a message cannot be sent; the rest of the result is not sent then.
+inline bool sendResult(Transport& transport, const std::string& queueName,
+                       messages::ResultMessage& result, std::string& output)
+{
+    size_t payloadBytes = result.replacedText.size();
+    for ( const auto& [count, sentence] : result.sortedSentences ) {
+        payloadBytes += sentence.size();
+    }
+
+    if ( payloadBytes <= RESULT_CHUNK_BYTES ) {
+        result.chunked = false;
+        result.toJson(output);
+        return transport.sendMessage(output, queueName);
+    }
+
+    auto sentences = std::move(result.sortedSentences);
+    auto text = std::move(result.replacedText);
+    result.sortedSentences.clear();
+    result.replacedText.clear();
+    result.chunked = true;
+    result.streamId = newStreamId();
+    result.toJson(output);
+    if ( not transport.sendMessage(output, queueName) ) { return false; }
+
+    messages::ResultChunk chunk;
+    chunk.taskId = result.taskId;
+    chunk.firstSection = result.firstSection;
+    chunk.streamId = result.streamId;
+
+    auto flush = [&](bool last) {
+        chunk.last = last;
+        chunk.toJson(output);
+        bool sent = transport.sendMessage(output, queueName);
+        ++chunk.seq;
+        chunk.sortedSentences.clear();
+        chunk.text.clear();
+        return sent;
+    };
+
+    size_t chunkBytes = 0;
+    for ( auto& sentence : sentences ) {
+        chunkBytes += sentence.second.size();
+        chunk.sortedSentences.push_back(std::move(sentence));
+        if ( chunkBytes >= RESULT_CHUNK_BYTES ) {
+            if ( not flush(false) ) { return false; }
+            chunkBytes = 0;
+        }
+    }
+
+    std::string_view rest = text;
+    while ( rest.size() > RESULT_CHUNK_BYTES - chunkBytes ) {
+        size_t room = RESULT_CHUNK_BYTES - chunkBytes;
+        if ( room < 4 ) {
+            if ( not flush(false) ) { return false; }
+            chunkBytes = 0;
+            continue;
+        }
+
+        size_t cut = utf8Cut(rest, room);
+        chunk.text.assign(rest.data(), cut);
+        rest.remove_prefix(cut);
+        if ( not flush(false) ) { return false; }
+        chunkBytes = 0;
+    }
+
+    chunk.text.assign(rest.data(), rest.size());
+    return flush(true);
+}
+
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cctype>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Tokenizers shared by the worker's handlers and the loader's precompute
+// pass, so stored per-section partials match what the handlers compute.
+namespace text {
+
+inline size_t countWords(std::string_view text)
+{
+    if ( text.empty() ) { return 0; }
+
+    size_t wordCount = 0;
+    bool inWord = false;
+
+    for ( char c : text ) {
+        if ( std::isspace(c) or std::iscntrl(c) ) {
+            if ( inWord ) {
+                ++wordCount;
+                inWord = false;
+            }
+        } else {
+            inWord = true;
+        }
+    }
+
+    if ( inWord ) { ++wordCount; }
+
+    return wordCount;
+}
+
+inline std::vector<std::string> extractWords(std::string_view text)
+{
+    std::vector<std::string> words;
+    std::string currentWord;
+
+    for ( char c : text ) {
+        if ( std::isalnum(c) or c == '\'' or c == '-' ) {
+            currentWord += std::tolower(c);
+        } else {
+            if ( not currentWord.empty() ) {
+                words.push_back(currentWord);
+                currentWord.clear();
+            }
+        }
+    }
+
+    if ( not currentWord.empty() ) { words.push_back(currentWord); }
+
+    return words;
+}
+
+inline bool isPositive(const std::string& word)
+{
+    static const std::unordered_set<std::string> positiveWords = {
+        "good", "great", "excellent", "wonderful", "amazing", "fantastic", "beautiful",
+        "happy", "joy", "love", "like", "best", "better", "perfect", "brilliant",
+        "positive", "success", "win", "victory", "hope", "bright", "cheerful",
+        "delight", "pleasure", "enjoy", "satisfaction", "pleased", "glad", "nice"
+    };
+    return positiveWords.find(word) != positiveWords.end();
+}
+
+inline bool isNegative(const std::string& word)
+{
+    static const std::unordered_set<std::string> negativeWords = {
+        "bad", "terrible", "awful", "horrible", "worst", "hate", "dislike",
+        "sad", "angry", "fear", "worry", "problem", "difficult", "hard",
+        "negative", "failure", "lose", "defeat", "despair", "dark", "gloomy",
+        "pain", "suffering", "disappointment", "disgust", "horror", "evil", "wrong"
+    };
+    return negativeWords.find(word) != negativeWords.end();
+}
+
+inline int tonality(int positiveCount, int negativeCount)
+{
+    if ( positiveCount > negativeCount * 1.2 ) { return 1; }
+    if ( negativeCount > positiveCount * 1.2 ) { return -1; }
+    return 0;
+}
+
+// (offset, length) of every sentence in text, trimmed of surrounding whitespace.
+inline std::vector<std::pair<size_t, size_t>> sentenceSpans(std::string_view text)
+{
+    std::vector<std::pair<size_t, size_t>> spans;
+
+    auto addTrimmed = [&](size_t begin, size_t end) {
+        auto piece = text.substr(begin, end - begin);
+        size_t first = piece.find_first_not_of(" \t\n\r");
+        if ( first == std::string_view::npos ) { return; }
+
+        size_t last = piece.find_last_not_of(" \t\n\r");
+        spans.emplace_back(begin + first, last - first + 1);
+    };
+
+    size_t start = 0;
+    for ( size_t i = 0; i < text.length(); ++i ) {
+        char c = text[i];
+
+        if ( c == '.' or c == '!' or c == '?' ) {
+            if ( i + 1 >= text.length() or std::isspace(text[i + 1]) or
+                 (i + 2 < text.length() and std::isupper(text[i + 2])) ) {
+                addTrimmed(start, i + 1);
+                start = i + 1;
+            }
+        }
+    }
+
+    if ( start < text.length() ) { addTrimmed(start, text.length()); }
+
+    return spans;
+}
+
+inline std::vector<std::pair<size_t, std::string>> splitSentences(std::string_view text)
+{
+    std::vector<std::pair<size_t, std::string>> sentences;
+    for ( auto [offset, length] : sentenceSpans(text) ) {
+        sentences.emplace_back(length, std::string(text.substr(offset, length)));
+    }
+    return sentences;
+}
+
+// Partial results of one section, as stored in section_stats. Tokens are
+// "word count word count ..." and spans "{offset,length,...}"; both are
+// views into the fetched rows.
+struct SectionStats {
+    size_t wordsCount{0};
+    int positiveCount{0};
+    int negativeCount{0};
+    std::string_view tokens;
+    std::string_view sentenceSpans;
+};
+
+// Word frequencies of text in order of first occurrence, encoded for
+// SectionStats::tokens.
+inline std::string encodeTokens(std::string_view text)
+{
+    std::unordered_map<std::string, size_t> counts;
+    std::vector<const std::string*> order;
+
+    for ( auto& word : extractWords(text) ) {
+        auto [it, inserted] = counts.try_emplace(std::move(word), 0);
+        if ( inserted ) { order.push_back(&it->first); }
+        ++it->second;
+    }
+
+    std::string encoded;
+    for ( const auto* word : order ) {
+        if ( not encoded.empty() ) { encoded += ' '; }
+        encoded += *word;
+        encoded += ' ';
+        encoded += std::to_string(counts[*word]);
+    }
+    return encoded;
+}
+
+template <typename Fn>
+void forEachToken(std::string_view tokens, Fn&& fn)
+{
+    const char* end = tokens.data() + tokens.size();
+    size_t pos = 0;
+    while ( pos < tokens.size() ) {
+        size_t wordEnd = tokens.find(' ', pos);
+        if ( wordEnd == std::string_view::npos ) { return; }
+
+        size_t count = 0;
+        auto [next, error] = std::from_chars(tokens.data() + wordEnd + 1, end, count);
+        if ( error != std::errc() ) { return; }
+
+        fn(tokens.substr(pos, wordEnd - pos), count);
+        pos = next - tokens.data() + 1;
+    }
+}
+
+// Postgres array literal of flattened (offset, length) pairs.
+inline std::string encodeSpans(const std::vector<std::pair<size_t, size_t>>& spans)
+{
+    std::string encoded = "{";
+    for ( auto [offset, length] : spans ) {
+        if ( encoded.size() > 1 ) { encoded += ','; }
+        encoded += std::to_string(offset);
+        encoded += ',';
+        encoded += std::to_string(length);
+    }
+    encoded += '}';
+    return encoded;
+}
+
+template <typename Fn>
+void forEachSpan(std::string_view spans, Fn&& fn)
+{
+    const char* pos = spans.data();
+    const char* end = spans.data() + spans.size();
+    while ( pos < end and (*pos == '{' or *pos == ',') ) {
+        size_t offset = 0;
+        size_t length = 0;
+        auto parsed = std::from_chars(pos + 1, end, offset);
+        if ( parsed.ec != std::errc() or parsed.ptr == end or *parsed.ptr != ',' ) { return; }
+
+        parsed = std::from_chars(parsed.ptr + 1, end, length);
+        if ( parsed.ec != std::errc() ) { return; }
+
+        fn(offset, length);
+        pos = parsed.ptr;
+    }
+}
+
+}
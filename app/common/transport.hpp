@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Queue-level messaging interface the pipeline stages are written against.
+// RabbitMQ is the production backend; InProcessTransport lets the whole
+// pipeline run inside one process without a broker, and ShmTransport links
+// stages that share a host.
+class Transport {
+private:
+    std::string viewBuffer_;
+
+public:
+    virtual ~Transport() = default;
+
+    virtual bool declareQueue(const std::string& queueName) = 0;
+    virtual bool sendMessage(const std::string& message, const std::string& queueName) = 0;
+    virtual bool startConsuming(const std::string& queueName) = 0;
+    virtual bool receiveMessage(std::string& message, int timeout_sec = 1) = 0;
+    virtual bool isConnected() const = 0;
+
+    // A queue that only lives as long as this connection consumes it, for
+    // queues private to one process. Backends that cannot tie a queue's
+    // lifetime to its consumer declare a regular one.
+    virtual bool declareTemporaryQueue(const std::string& queueName)
+    {
+        return declareQueue(queueName);
+    }
+
+    // The view stays valid until the next receive call. Backends without
+    // in-place delivery copy into an internal buffer.
+    virtual bool receiveView(std::string_view& message, int timeout_sec = 1)
+    {
+        if ( not receiveMessage(viewBuffer_, timeout_sec) ) { return false; }
+        message = viewBuffer_;
+        return true;
+    }
+
+    virtual bool deliversInPlace() const
+    {
+        return false;
+    }
+
+    // Non-blocking pull of one message from any queue, independent of the
+    // consumer set up by startConsuming. Backends that cannot do this return false.
+    virtual bool getMessage(const std::string& queueName, std::string& message)
+    {
+        return false;
+    }
+
+    // With deferred acknowledgement a received message stays with the broker,
+    // and is redelivered if this process dies, until acknowledge() or the
+    // next receive. Backends without acknowledgements ignore both.
+    virtual void setDeferredAck(bool deferred) {}
+    virtual void acknowledge() {}
+
+    // Messages waiting in the queue, or -1 if the backend cannot tell.
+    virtual long messageCount(const std::string& queueName)
+    {
+        return -1;
+    }
+
+    // Consumers attached to the queue, or -1 if the backend cannot tell.
+    virtual long consumerCount(const std::string& queueName)
+    {
+        return -1;
+    }
+};
@@ -1,3 +1,4 @@
+import hashlib
 import os
 import psycopg2
 
@@ -6,20 +7,29 @@ CHUNK_SIZE = 1024  # 1 KB
 
 
 def insert_text(conn, name):
+    # Names are unique; None when the text is already loaded.
     with conn.cursor() as cur:
         cur.execute(
-            "INSERT INTO texts(name) VALUES (%s) RETURNING id",
+            "INSERT INTO texts(name) VALUES (%s) ON CONFLICT (name) DO NOTHING RETURNING id",
             (name,)
         )
-        return cur.fetchone()[0]
+        row = cur.fetchone()
+        return row[0] if row else None
 
 
 def insert_section(conn, text_id, section_number, content):
+    data = content.encode("utf-8")
+    content_hash = hashlib.sha256(data).digest()
     with conn.cursor() as cur:
         cur.execute(
-            """INSERT INTO sections(text_id, section_number, content)
+            """INSERT INTO section_contents(hash, bytes, content)
+               VALUES (%s, %s, %s) ON CONFLICT (hash) DO NOTHING""",
+            (content_hash, len(data), content)
+        )
+        cur.execute(
+            """INSERT INTO sections(text_id, section_number, content_hash)
                VALUES (%s, %s, %s)""",
-            (text_id, section_number, content)
+            (text_id, section_number, content_hash)
         )
 
 
@@ -47,6 +57,9 @@ def main():
             data = f.read()
 
         text_id = insert_text(conn, name)
+        if text_id is None:
+            print(f"Skipping {filename}, already loaded")
+            continue
 
         section_number = 1
         offset = 0
@@ -1,19 +1,46 @@
 #include <iostream>
-#include <fstream>
 #include <filesystem>
 #include <pqxx/pqxx>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "args.hpp"
+#include "compression.hpp"
 #include "constants.hpp"
+#include "precompute.hpp"
+#include "sections.hpp"
+#include "sha256.hpp"
 
 namespace fs = std::filesystem;
 
-std::string sanitizeUTF8(const std::string& input) {
-    std::string output;
-    output.reserve(input.size());
+// Appends the sanitized input to output and returns how many input bytes
+// were consumed. Unless last is set, a sequence cut off by the end of input
+// is left unconsumed so the caller can retry it with the next block.
+size_t sanitizeUTF8(std::string_view input, std::string& output, bool last = true) {
+    output.reserve(output.size() + input.size());
     
     for (size_t i = 0; i < input.size(); ++i) {
         unsigned char c = static_cast<unsigned char>(input[i]);
+
+        if ( not last ) {
+            size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC2 ? 2 : 1;
+            if ( i + length > input.size() ) { return i; }
+        }
         
         // ASCII character (0x00-0x7F)
         if (c <= 0x7F) {
@@ -94,7 +121,7 @@ std::string sanitizeUTF8(const std::string& input) {
         }
     }
     
-    return output;
+    return input.size();
 }
 
 // Check if a byte is a continuation byte in UTF-8
@@ -103,7 +130,7 @@ inline bool isUTF8Continuation(unsigned char c) {
 }
 
 // Find the start of the current UTF-8 character by going backwards
-size_t findUTF8CharStart(const std::string& str, size_t pos) {
+size_t findUTF8CharStart(std::string_view str, size_t pos) {
     if (pos == 0) return 0;
     
     // Go backwards until we find a non-continuation byte
@@ -132,72 +159,522 @@ size_t findUTF8CharStart(const std::string& str, size_t pos) {
     return pos;
 }
 
-std::vector<std::string> splitByChunks(const std::string& content, size_t chunkSize = 1024) {
-    std::vector<std::string> chunks;
-    
-    for ( size_t i = 0; i < content.length(); ) {
-        size_t end = std::min(i + chunkSize, content.length());
-        
-        // If we're not at the end of the string, make sure we don't split in the middle of a UTF-8 character
-        if (end < content.length()) {
-            // Check if the byte at 'end' is a continuation byte
-            if (isUTF8Continuation(static_cast<unsigned char>(content[end]))) {
-                // Find the start of this UTF-8 character and adjust 'end' to before it
-                end = findUTF8CharStart(content, end);
+// Cuts sanitized text into sections of at most chunkSize bytes without
+// splitting a UTF-8 character. Text is fed block by block; only the tail
+// that does not make a full section yet is kept between blocks.
+class SectionChunker {
+private:
+    size_t chunkSize_;
+    std::string pending_;
+
+public:
+    explicit SectionChunker(size_t chunkSize) : chunkSize_(chunkSize) {}
+
+    template <typename Emit>
+    void feed(std::string_view text, Emit&& emit) {
+        pending_.append(text);
+
+        size_t i = 0;
+        // A cut needs the byte after it, so the last chunkSize bytes wait.
+        while ( pending_.size() - i > chunkSize_ ) {
+            size_t end = i + chunkSize_;
+            if ( isUTF8Continuation(static_cast<unsigned char>(pending_[end])) ) {
+                end = findUTF8CharStart(pending_, end);
             }
+            
+            emit(std::string_view(pending_).substr(i, end - i));
+            i = end;
         }
-        
-        chunks.push_back(content.substr(i, end - i));
-        i = end;
+        pending_.erase(0, i);
     }
-    
-    return chunks;
+
+    template <typename Emit>
+    void finish(Emit&& emit) {
+        if ( not pending_.empty() ) { emit(std::string_view(pending_)); }
+        pending_.clear();
+    }
+};
+
+// Read-only mapping of a whole file. Pages are read ahead sequentially and
+// dropped once consumed, so resident memory stays flat for any file size.
+class MappedFile {
+private:
+    const char* data_{nullptr};
+    size_t size_{0};
+
+public:
+    explicit MappedFile(const std::string& filePath) {
+        int fd = open(filePath.c_str(), O_RDONLY);
+        if ( fd < 0 ) { throw std::runtime_error("Cannot open file: " + filePath); }
+
+        struct stat st{};
+        if ( fstat(fd, &st) != 0 ) {
+            close(fd);
+            throw std::runtime_error("Cannot stat file: " + filePath);
+        }
+
+        size_ = st.st_size;
+        if ( size_ > 0 ) {
+            void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if ( addr == MAP_FAILED ) {
+                close(fd);
+                throw std::runtime_error("Cannot map file: " + filePath);
+            }
+            data_ = static_cast<const char*>(addr);
+            madvise(addr, size_, MADV_SEQUENTIAL);
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if ( data_ ) { munmap(const_cast<char*>(data_), size_); }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const { return {data_, size_}; }
+
+    // Starts reading [begin, end) ahead of the threads that will touch it.
+    void prefetch(size_t begin, size_t end) const {
+        static const size_t pageSize = sysconf(_SC_PAGESIZE);
+        begin -= begin % pageSize;
+        if ( end > begin ) { madvise(const_cast<char*>(data_) + begin, end - begin, MADV_WILLNEED); }
+    }
+
+    // Drops the pages of [0, end) from this process; page-aligned internally.
+    void release(size_t end) const {
+        static const size_t pageSize = sysconf(_SC_PAGESIZE);
+        end -= end % pageSize;
+        if ( end > 0 ) { madvise(const_cast<char*>(data_), end, MADV_DONTNEED); }
+    }
+};
+
+// Sanitizes and chunks the file in LOADER_BLOCK_BYTES blocks and hands each
+// section to emit as soon as it is complete.
+template <typename Emit>
+void streamSections(const std::string& filePath, Emit&& emit) {
+    MappedFile file(filePath);
+    auto content = file.view();
+
+    SectionChunker chunker(LOADER_SECTION_BYTES);
+    std::string sanitized;
+
+    size_t pos = 0;
+    while ( pos < content.size() ) {
+        auto block = content.substr(pos, LOADER_BLOCK_BYTES);
+        bool last = pos + block.size() == content.size();
+
+        sanitized.clear();
+        size_t consumed = sanitizeUTF8(block, sanitized, last);
+        // A block that is nothing but a cut-off sequence still has to move on.
+        if ( consumed == 0 ) { consumed = sanitizeUTF8(block, sanitized, true); }
+
+        chunker.feed(sanitized, emit);
+        pos += consumed;
+        file.release(pos);
+    }
+    chunker.finish(emit);
 }
 
-std::string readTextFile(const std::string& filePath) {
-    if ( std::ifstream file(filePath); file ) {
-        return std::string(std::istreambuf_iterator<char>(file),
-                       std::istreambuf_iterator<char>());
-    } else {
-        throw std::runtime_error("Cannot open file: " + filePath);
-    }    
+// Blocking queue of fixed capacity between two loader pipeline stages.
+template <typename T>
+class BoundedQueue {
+private:
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<T> items_;
+    size_t capacity_;
+    bool closed_{false};
+
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+    // Blocks while the queue is full; returns false once it is closed.
+    bool push(T item) {
+        std::unique_lock lock(mutex_);
+        notFull_.wait(lock, [&] { return closed_ or items_.size() < capacity_; });
+        if ( closed_ ) { return false; }
+
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty; returns false once it is closed and drained.
+    bool pop(T& item) {
+        std::unique_lock lock(mutex_);
+        notEmpty_.wait(lock, [&] { return closed_ or not items_.empty(); });
+        if ( items_.empty() ) { return false; }
+
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+};
+
+// Hands sanitized blocks to the writer in file order. No more than window
+// blocks are between the reader and the writer at a time, which bounds
+// memory however far the sanitizers get ahead of the database.
+class BlockSequence {
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::map<size_t, std::string> ready_;
+    size_t next_{0};
+    size_t total_{std::numeric_limits<size_t>::max()};
+    size_t window_;
+    bool aborted_{false};
+
+public:
+    explicit BlockSequence(size_t window) : window_(window) {}
+
+    // Waits until block index may enter the pipeline.
+    bool admit(size_t index) {
+        std::unique_lock lock(mutex_);
+        changed_.wait(lock, [&] { return aborted_ or index < next_ + window_; });
+        return not aborted_;
+    }
+
+    void put(size_t index, std::string block) {
+        std::lock_guard lock(mutex_);
+        ready_.emplace(index, std::move(block));
+        changed_.notify_all();
+    }
+
+    void end(size_t total) {
+        std::lock_guard lock(mutex_);
+        total_ = total;
+        changed_.notify_all();
+    }
+
+    // Takes the next block in order; returns false after the last one.
+    bool take(std::string& block) {
+        std::unique_lock lock(mutex_);
+        changed_.wait(lock, [&] { return aborted_ or next_ == total_ or ready_.count(next_) > 0; });
+        if ( aborted_ or next_ == total_ ) { return false; }
+
+        auto it = ready_.find(next_);
+        block = std::move(it->second);
+        ready_.erase(it);
+        ++next_;
+        changed_.notify_all();
+        return true;
+    }
+
+    void abort() {
+        std::lock_guard lock(mutex_);
+        aborted_ = true;
+        changed_.notify_all();
+    }
+};
+
+// First position at or after end where content can be split without
+// changing how it sanitizes, i.e. no sequence, valid or not, runs across
+// it: any byte that is not a continuation byte, or a continuation byte
+// with no lead byte among the three before it.
+size_t safeBlockEnd(std::string_view content, size_t end) {
+    for ( ; end < content.size(); ++end ) {
+        if ( not isUTF8Continuation(static_cast<unsigned char>(content[end])) ) { return end; }
+
+        bool spanned = false;
+        for ( size_t back = 1; back <= 3 and back <= end; ++back ) {
+            if ( static_cast<unsigned char>(content[end - back]) >= 0xC0 ) { spanned = true; }
+        }
+        if ( not spanned ) { return end; }
+    }
+    return content.size();
 }
 
-void insertTextAndSections(pqxx::connection& conn, const std::string& textName, 
-                          const std::vector<std::string>& sections) {
+// Same sections as streamSections, produced by a staged pipeline: a reader
+// cuts the file into blocks at safe boundaries and reads them ahead, threads
+// sanitize blocks in parallel, and the calling thread chunks them in order
+// and emits, so a single large file keeps every core and the writer busy.
+template <typename Emit>
+void streamSections(const std::string& filePath, int threads, Emit&& emit) {
+    if ( threads <= 1 ) {
+        streamSections(filePath, emit);
+        return;
+    }
+
+    MappedFile file(filePath);
+    auto content = file.view();
+
+    struct Block {
+        size_t index;
+        size_t begin;
+        size_t end;
+    };
+
+    size_t window = 2 * threads;
+    BoundedQueue<Block> blocks(window);
+    BlockSequence sanitized(window);
+
+    std::thread reader([&] {
+        size_t index = 0;
+        for ( size_t pos = 0; pos < content.size(); ++index ) {
+            size_t end = safeBlockEnd(content, pos + LOADER_BLOCK_BYTES);
+            if ( not sanitized.admit(index) ) { break; }
+
+            file.prefetch(pos, end);
+            if ( not blocks.push({index, pos, end}) ) { break; }
+            pos = end;
+        }
+        sanitized.end(index);
+        blocks.close();
+    });
+
+    std::vector<std::thread> sanitizers;
+    for ( int i = 0; i < threads; ++i ) {
+        sanitizers.emplace_back([&] {
+            Block block{};
+            while ( blocks.pop(block) ) {
+                std::string output;
+                sanitizeUTF8(content.substr(block.begin, block.end - block.begin), output, true);
+                sanitized.put(block.index, std::move(output));
+            }
+        });
+    }
+
+    auto join = [&] {
+        reader.join();
+        for ( auto& thread : sanitizers ) {
+            thread.join();
+        }
+    };
+
+    SectionChunker chunker(LOADER_SECTION_BYTES);
+    try {
+        std::string block;
+        size_t written = 0;
+        while ( sanitized.take(block) ) {
+            chunker.feed(block, emit);
+            // Sanitizing maps every input byte to one output byte.
+            written += block.size();
+            file.release(written);
+        }
+        chunker.finish(emit);
+    } catch ( ... ) {
+        sanitized.abort();
+        blocks.close();
+        join();
+        throw;
+    }
+    join();
+}
+
+// SHA-256 of the whole file, read block by block like streamSections.
+Sha256::Digest hashFile(const std::string& filePath) {
+    MappedFile file(filePath);
+    auto content = file.view();
+
+    Sha256 hash;
+    for ( size_t pos = 0; pos < content.size(); pos += LOADER_BLOCK_BYTES ) {
+        hash.update(content.substr(pos, LOADER_BLOCK_BYTES));
+        file.release(pos + LOADER_BLOCK_BYTES);
+    }
+    return hash.digest();
+}
+
+std::basic_string_view<std::byte> asBytes(std::string_view data) {
+    return {reinterpret_cast<const std::byte*>(data.data()), data.size()};
+}
+
+std::basic_string_view<std::byte> asBytes(const Sha256::Digest& digest) {
+    return {reinterpret_cast<const std::byte*>(digest.data()), digest.size()};
+}
+
+// Streams the file's sections into one COPY inside the transaction that
+// creates the text; only the blocks in flight are held in memory. With
+// compress, each section is stored as a zstd frame in packed instead of
+// plain content. Sections are staged in a temporary table and only contents
+// not stored yet are inserted.
+//
+// Returns false when the text is already loaded from the same bytes. A
+// changed file replaces the text's sections under the same id and name.
+// Batches read sections by number, so a text with unfinished tasks is not
+// reloaded; the row lock keeps the splitter from registering new ones
+// meanwhile.
+bool insertTextAndSections(pqxx::connection& conn, const std::string& textName, const std::string& filePath,
+                           int threads, bool compress) {
+    auto fileHash = hashFile(filePath);
     pqxx::work txn(conn);
     
     try {
-        auto textResult = txn.exec_params(
-            "INSERT INTO texts (name) VALUES ($1) RETURNING id",
-            textName
-        );
-        
-        if ( textResult.empty() ) { throw std::runtime_error("Failed to insert text: " + textName); }
-        
-        auto textId = textResult[0][0].as<int>();
-        
-        for ( size_t i = 0; i < sections.size(); ++i ) {
+        auto existing = txn.exec_params("SELECT id, content_hash FROM texts WHERE name = $1 FOR UPDATE", textName);
+
+        int textId = 0;
+        if ( existing.empty() ) {
+            auto textResult = txn.exec_params(
+                "INSERT INTO texts (name, storage, content_hash) VALUES ($1, $2, $3) RETURNING id",
+                textName,
+                compress ? "zstd" : "text",
+                asBytes(fileHash)
+            );
+            if ( textResult.empty() ) { throw std::runtime_error("Failed to insert text: " + textName); }
+            textId = textResult[0][0].as<int>();
+        } else {
+            textId = existing[0][0].as<int>();
+            if ( not existing[0][1].is_null() and existing[0][1].as<db::Bytes>() == db::Bytes(asBytes(fileHash)) ) {
+                txn.abort();
+                return false;
+            }
+
+            auto unfinished = txn.exec_params(
+                "SELECT count(*) FROM tasks WHERE text_id = $1 AND status IN ('publishing', 'published') "
+                "AND created_at > CURRENT_TIMESTAMP - make_interval(secs => $2)",
+                textId,
+                RELOAD_TASK_TIMEOUT_SEC
+            )[0][0].as<long>();
+            if ( unfinished > 0 ) {
+                throw std::runtime_error("Text has " + std::to_string(unfinished) + " unfinished task(s)");
+            }
+
+            txn.exec_params("DELETE FROM sections WHERE text_id = $1", textId);
             txn.exec_params(
-                "INSERT INTO sections (text_id, content, section_number) VALUES ($1, $2, $3)",
+                "UPDATE texts SET content_hash = $2, storage = $3, stats_ready = FALSE, "
+                "created_at = CURRENT_TIMESTAMP WHERE id = $1",
                 textId,
-                sections[i],
-                static_cast<int>(i + 1)
+                asBytes(fileHash),
+                compress ? "zstd" : "text"
             );
         }
         
+        int sectionCount = 0;
+        size_t totalBytes = 0;
+
+        auto compressor = db::sectionCompressor();
+        std::string packed;
+
+        txn.exec(
+            "CREATE TEMP TABLE staged_sections "
+            "(section_number INTEGER, hash BYTEA, bytes INTEGER, content TEXT, packed BYTEA) ON COMMIT DROP"
+        );
+
+        // One COPY stream instead of a round trip per section.
+        auto stream = pqxx::stream_to::table(txn, {"staged_sections"},
+                                             {"section_number", "hash", "bytes", compress ? "packed" : "content"});
+        streamSections(filePath, threads, [&](std::string_view section) {
+            auto sectionHash = Sha256::of(section);
+            auto sectionBytes = static_cast<int>(section.size());
+            if ( compress ) {
+                if ( not compressor.compress(compression::Codec::Zstd, section, packed) ) {
+                    throw std::runtime_error("Cannot compress section");
+                }
+                stream.write_values(++sectionCount, asBytes(sectionHash), sectionBytes, asBytes(packed));
+            } else {
+                stream.write_values(++sectionCount, asBytes(sectionHash), sectionBytes, section);
+            }
+            totalBytes += section.size();
+        });
+        stream.complete();
+
+        txn.exec(
+            "INSERT INTO section_contents (hash, bytes, content, packed) "
+            "SELECT DISTINCT ON (hash) hash, bytes, content, packed FROM staged_sections "
+            "ON CONFLICT (hash) DO NOTHING"
+        );
+        txn.exec_params(
+            "INSERT INTO sections (text_id, section_number, content_hash) "
+            "SELECT $1, section_number, hash FROM staged_sections",
+            textId
+        );
+
+        txn.exec_params(
+            "UPDATE texts SET section_count = $2, total_bytes = $3 WHERE id = $1",
+            textId,
+            sectionCount,
+            static_cast<long>(totalBytes)
+        );
+        
         txn.commit();
+        return true;
     } catch (const std::exception& e) {
         txn.abort();
         throw;
     }
 }
 
+// Secondary indexes on sections. The unique (text_id, section_number)
+// constraint stays in place during loads since it guards correctness.
+static const std::vector<std::pair<std::string, std::string>> sectionIndexes = {
+    {"idx_sections_text_id", "sections(text_id)"},
+    {"idx_sections_section_number", "sections(section_number)"},
+};
+
+void dropSectionIndexes(pqxx::connection& conn) {
+    pqxx::work txn(conn);
+    for ( const auto& [name, target] : sectionIndexes ) {
+        txn.exec("DROP INDEX IF EXISTS " + name);
+    }
+    txn.commit();
+}
+
+void createSectionIndexes(pqxx::connection& conn) {
+    pqxx::work txn(conn);
+    for ( const auto& [name, target] : sectionIndexes ) {
+        txn.exec("CREATE INDEX IF NOT EXISTS " + name + " ON " + target);
+    }
+    txn.commit();
+}
+
+static void printUsage() {
+    std::cout << "Usage: loader [--defer-indexes] [--compress] [--stats | --stats-only] [-j <jobs>] "
+                 "[-p <file threads>] [<texts_dir>]" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
     std::string textsDir = "texts";
+    bool deferIndexes = false;
+    bool compress = false;
+    bool stats = false;
+    bool statsOnly = false;
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    int jobs = cores;
+    int fileThreads = 0;
+    
+    for ( int i = 1; i < argc; ++i ) {
+        std::string arg = argv[i];
+        if ( arg == "--defer-indexes" ) {
+            deferIndexes = true;
+        } else if ( arg == "--compress" ) {
+            compress = true;
+        } else if ( arg == "--stats" ) {
+            stats = true;
+        } else if ( arg == "--stats-only" ) {
+            statsOnly = true;
+        } else if ( arg == "-j" and i + 1 < argc ) {
+            if ( not args::parseInt(argv[++i], jobs, 1) ) {
+                printUsage();
+                return 1;
+            }
+        } else if ( arg == "-p" and i + 1 < argc ) {
+            if ( not args::parseInt(argv[++i], fileThreads, 0) ) {
+                printUsage();
+                return 1;
+            }
+        } else if ( not arg.empty() and arg[0] == '-' ) {
+            printUsage();
+            return 1;
+        } else {
+            textsDir = arg;
+        }
+    }
     
-    if (argc > 1) {
-        textsDir = argv[1];
+    // Per-section partials for every text that has none yet, e.g. texts
+    // loaded before --stats was used.
+    if ( statsOnly ) {
+        pqxx::connection conn(DB_CONN_STRING);
+        return precompute::precomputeStats(conn, cores) > 0 ? 1 : 0;
     }
     
     if ( not fs::exists(textsDir) or not fs::is_directory(textsDir)) {
@@ -205,6 +682,11 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    if ( compress and not compression::isAvailable(compression::Codec::Zstd) ) {
+        std::cerr << "Error: --compress needs a build with zstd" << std::endl;
+        return 1;
+    }
+    
     pqxx::connection conn(DB_CONN_STRING);
     if ( not conn.is_open() ) {
         std::cerr << "Error: Cannot connect to database" << std::endl;
@@ -222,25 +704,67 @@ int main(int argc, char* argv[]) {
     }
     
     std::sort(textFiles.begin(), textFiles.end());
+
+    // Building the indexes once after a large load is cheaper than
+    // maintaining them row by row.
+    if ( deferIndexes ) { dropSectionIndexes(conn); }
     
-    for ( const auto& textFile : textFiles ) {
-        std::string textName = textFile.stem().string();
-        std::string filePath = textFile.string();
-        
-        try {
-            std::string content = readTextFile(filePath);
-            
-            // Sanitize UTF-8 to remove invalid sequences
-            content = sanitizeUTF8(content);
-            
-            std::vector<std::string> sections = splitByChunks(content, 1024);
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> loaded{0};
+    std::atomic<size_t> unchanged{0};
+    std::atomic<size_t> failed{0};
+    std::mutex outputMutex;
+
+    // Each thread keeps one connection for all the files it loads, so the
+    // pool of connections is bounded by the number of jobs.
+    auto loadFiles = [&] {
+        std::optional<pqxx::connection> threadConn;
+        for ( size_t i = next++; i < textFiles.size(); i = next++ ) {
+            std::string textName = textFiles[i].stem().string();
+            std::string filePath = textFiles[i].string();
             
-            insertTextAndSections(conn, textName, sections);
-        } catch ( const std::exception& e ) {
-            std::cerr << "Error loading '" << textName << "': " << e.what() << std::endl;
+            try {
+                if ( not threadConn ) { threadConn.emplace(DB_CONN_STRING); }
+
+                bool inserted = insertTextAndSections(*threadConn, textName, filePath, fileThreads, compress);
+
+                ++(inserted ? loaded : unchanged);
+
+                size_t done = loaded + unchanged + failed;
+                std::lock_guard lock(outputMutex);
+                std::cout << "[" << done << "/" << textFiles.size() << "] " << textName
+                          << (inserted ? "" : " (unchanged)") << std::endl;
+            } catch ( const std::exception& e ) {
+                ++failed;
+                // A broken connection is replaced for the next file.
+                if ( threadConn and not threadConn->is_open() ) { threadConn.reset(); }
+
+                std::lock_guard lock(outputMutex);
+                std::cerr << "Error loading '" << textName << "': " << e.what() << std::endl;
+            }
         }
+    };
+
+    jobs = std::clamp(jobs, 1, static_cast<int>(textFiles.size()));
+    // Cores not taken by whole files go to sanitizing within each file.
+    if ( fileThreads <= 0 ) { fileThreads = std::max(1, cores / jobs); }
+    std::vector<std::thread> threads;
+    for ( int i = 0; i < jobs; ++i ) {
+        threads.emplace_back(loadFiles);
     }
+    for ( auto& thread : threads ) {
+        thread.join();
+    }
+
+    std::cout << "Loaded " << loaded << " of " << textFiles.size() << " file(s)";
+    if ( unchanged > 0 ) { std::cout << ", " << unchanged << " unchanged"; }
+    if ( failed > 0 ) { std::cout << ", " << failed << " failed"; }
+    std::cout << std::endl;
+
+    if ( deferIndexes ) { createSectionIndexes(conn); }
+
+    if ( stats and precompute::precomputeStats(conn, cores) > 0 ) { return 1; }
     
-    return 0;
+    return failed > 0 ? 1 : 0;
 }
 
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <pqxx/pqxx>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "constants.hpp"
+#include "sections.hpp"
+#include "text.hpp"
+
+// Precompute pass: fills section_stats for the contents of every text not
+// marked stats_ready, so workers can merge these partials instead of
+// tokenizing the same sections for every task. Partials are keyed by
+// content hash, so a text reloaded meanwhile never gets stats of bytes it
+// no longer has; it is only left unmarked for the next pass.
+namespace precompute {
+
+// Sections read per query while a text is precomputed.
+inline const int READ_BATCH_SECTIONS = 256;
+
+struct PendingText {
+    int id;
+    std::string name;
+    int sectionCount;
+    // texts.created_at as read, which a reload changes.
+    std::string version;
+};
+
+inline std::vector<PendingText> pendingTexts(pqxx::connection& conn)
+{
+    pqxx::read_transaction txn(conn);
+    auto result = txn.exec(
+        "SELECT id, name, section_count, created_at::text FROM texts "
+        "WHERE NOT stats_ready AND section_count > 0 ORDER BY id"
+    );
+
+    std::vector<PendingText> texts;
+    for ( const auto& row : result ) {
+        texts.push_back({row[0].as<int>(), row[1].as<std::string>(), row[2].as<int>(), row[3].as<std::string>()});
+    }
+    return texts;
+}
+
+// Contents of a section range that have no partials yet, each once.
+inline const std::string PENDING_CONTENTS_QUERY =
+    "SELECT DISTINCT ON (c.hash) c.content, c.packed, c.hash "
+    "FROM sections s JOIN section_contents c ON c.hash = s.content_hash "
+    "LEFT JOIN section_stats st ON st.content_hash = c.hash "
+    "WHERE s.text_id = $1 AND s.section_number BETWEEN $2 AND $3 AND st.content_hash IS NULL";
+
+// Reads on one connection and streams the partials into one COPY on the
+// other, so a text is precomputed in a single transaction. Other texts may
+// share contents and be precomputed concurrently, so rows are staged and
+// only the missing ones inserted.
+inline void precomputeText(pqxx::connection& readConn, pqxx::connection& writeConn, const PendingText& textInfo)
+{
+    pqxx::nontransaction reader(readConn);
+    pqxx::work txn(writeConn);
+
+    txn.exec(
+        "CREATE TEMP TABLE staged_stats (content_hash BYTEA, words_count INTEGER, positive_count INTEGER, "
+        "negative_count INTEGER, tokens TEXT, sentence_spans INTEGER[]) ON COMMIT DROP"
+    );
+    auto stream = pqxx::stream_to::table(txn, {"staged_stats"},
+        {"content_hash", "words_count", "positive_count", "negative_count", "tokens", "sentence_spans"});
+
+    auto compressor = db::sectionCompressor();
+    std::string content;
+
+    for ( int first = 1; first <= textInfo.sectionCount; first += READ_BATCH_SECTIONS ) {
+        int last = std::min(first + READ_BATCH_SECTIONS - 1, textInfo.sectionCount);
+        auto rows = reader.exec_params(PENDING_CONTENTS_QUERY, textInfo.id, first, last);
+
+        for ( const auto& row : rows ) {
+            content.clear();
+            db::unpackSection(compressor, row, content);
+
+            int positiveCount = 0;
+            int negativeCount = 0;
+            for ( const auto& word : text::extractWords(content) ) {
+                if ( text::isPositive(word) ) {
+                    ++positiveCount;
+                } else if ( text::isNegative(word) ) {
+                    ++negativeCount;
+                }
+            }
+
+            stream.write_values(row[2].as<db::Bytes>(), static_cast<long>(text::countWords(content)),
+                                positiveCount, negativeCount,
+                                text::encodeTokens(content), text::encodeSpans(text::sentenceSpans(content)));
+        }
+    }
+    stream.complete();
+
+    txn.exec(
+        "INSERT INTO section_stats (content_hash, words_count, positive_count, negative_count, tokens, sentence_spans) "
+        "SELECT DISTINCT ON (content_hash) * FROM staged_stats ON CONFLICT (content_hash) DO NOTHING"
+    );
+    // A reload since pendingTexts may have brought contents this pass never saw.
+    txn.exec_params("UPDATE texts SET stats_ready = TRUE WHERE id = $1 AND created_at::text = $2",
+                    textInfo.id, textInfo.version);
+    txn.commit();
+}
+
+// Returns how many texts failed.
+inline size_t precomputeStats(pqxx::connection& conn, int jobs)
+{
+    auto texts = pendingTexts(conn);
+    if ( texts.empty() ) { return 0; }
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::atomic<size_t> failed{0};
+    std::mutex outputMutex;
+
+    auto precomputeTexts = [&] {
+        std::optional<pqxx::connection> readConn;
+        std::optional<pqxx::connection> writeConn;
+        for ( size_t i = next++; i < texts.size(); i = next++ ) {
+            try {
+                if ( not readConn ) { readConn.emplace(DB_CONN_STRING); }
+                if ( not writeConn ) { writeConn.emplace(DB_CONN_STRING); }
+
+                precomputeText(*readConn, *writeConn, texts[i]);
+
+                size_t count = ++done + failed;
+                std::lock_guard lock(outputMutex);
+                std::cout << "[stats " << count << "/" << texts.size() << "] " << texts[i].name << std::endl;
+            } catch ( const std::exception& e ) {
+                ++failed;
+                readConn.reset();
+                writeConn.reset();
+
+                std::lock_guard lock(outputMutex);
+                std::cerr << "Error precomputing '" << texts[i].name << "': " << e.what() << std::endl;
+            }
+        }
+    };
+
+    jobs = std::clamp(jobs, 1, static_cast<int>(texts.size()));
+    std::vector<std::thread> threads;
+    for ( int i = 0; i < jobs; ++i ) {
+        threads.emplace_back(precomputeTexts);
+    }
+    for ( auto& thread : threads ) {
+        thread.join();
+    }
+
+    std::cout << "Precomputed " << done << " of " << texts.size() << " text(s)";
+    if ( failed > 0 ) { std::cout << ", " << failed << " failed"; }
+    std::cout << std::endl;
+
+    return failed;
+}
+
+}
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <pqxx/pqxx>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "aggregator/aggregator.hpp"
+#include "args.hpp"
+#include "constants.hpp"
+#include "inprocess.hpp"
+#include "scheduler/scheduler.hpp"
+#include "sinker/sinker.hpp"
+#include "splitter/splitter.hpp"
+#include "worker/worker.hpp"
+
+// Runs splitter, workers, aggregator and sinker in one process over the
+// in-process transport. Useful to benchmark the pipeline without a broker.
+
+static void printUsage() {
+    std::cout << "Usage: pipeline [-w <workers>] <text_name>..." << std::endl;
+}
+
+// Runs one stage on its own thread. A stage that fails to start or throws,
+// e.g. when it cannot connect to Postgres, is counted in failed instead of
+// terminating the process.
+template <typename Stage>
+static std::thread startStage(const char* name, std::atomic<int>& failed, Stage stage) {
+    return std::thread([name, &failed, stage = std::move(stage)] {
+        try {
+            if ( stage() == 0 ) { return; }
+            std::cerr << "Error: " << name << " stopped" << std::endl;
+        } catch ( const std::exception& e ) {
+            std::cerr << "Error: " << name << " failed: " << e.what() << std::endl;
+        }
+        ++failed;
+    });
+}
+
+int main(int argc, char* argv[]) {
+    int workersCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> textNames;
+
+    for ( int i = 1; i < argc; ++i ) {
+        std::string arg = argv[i];
+        if ( arg == "-w" and i + 1 < argc ) {
+            if ( not args::parseInt(argv[++i], workersCount, 1) ) {
+                printUsage();
+                return 1;
+            }
+        } else {
+            textNames.push_back(arg);
+        }
+    }
+
+    if ( textNames.empty() or workersCount < 1 ) {
+        printUsage();
+        return 1;
+    }
+
+    inprocess::Broker broker;
+    std::atomic<int> run = 1;
+    std::atomic<int> failedStages = 0;
+    std::vector<std::thread> stages;
+
+    for ( int i = 0; i < workersCount; ++i ) {
+        int group = WORKER_GROUPS > 0 and SCHEDULER_ENABLED and WORK_DISTRIBUTION == "push" ? i % WORKER_GROUPS : -1;
+        stages.push_back(startStage("worker", failedStages, [&broker, &run, group] {
+            pqxx::connection conn{DB_CONN_STRING};
+            InProcessTransport transport{broker};
+            return runWorker(conn, transport, transport, run, group);
+        }));
+    }
+
+    for ( int shard = 0; shard < RESULT_SHARDS; ++shard ) {
+        stages.push_back(startStage("aggregator", failedStages, [&broker, &run, shard] {
+            InProcessTransport transport{broker};
+            pqxx::connection conn{DB_CONN_STRING};
+            return runAggregator(transport, transport, shard, run, &conn);
+        }));
+    }
+
+    if ( SCHEDULER_ENABLED or WORK_DISTRIBUTION == "pull" ) {
+        stages.push_back(startStage("scheduler", failedStages, [&broker, &run] {
+            InProcessTransport transport{broker};
+            return runScheduler(transport, run);
+        }));
+    }
+
+    InProcessTransport sinkerTransport{broker};
+    sinkerTransport.declareQueue(SINKER_QUEUE_NAME);
+    sinkerTransport.startConsuming(SINKER_QUEUE_NAME);
+
+    InProcessTransport splitterTransport{broker};
+    declareSubmitQueues(splitterTransport);
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto taskIds = submitTexts(textNames, SPLITTER_JOBS, "default", [&broker]() -> std::unique_ptr<Transport> {
+        return std::make_unique<InProcessTransport>(broker);
+    });
+    std::unordered_set<int> pending(taskIds.begin(), taskIds.end());
+
+    // Waits while tasks keep finishing and every stage is up.
+    ResultSink sink{"results"};
+    std::string_view message;
+    auto progressAt = std::chrono::steady_clock::now();
+    while ( not pending.empty() and failedStages == 0 and
+            std::chrono::steady_clock::now() - progressAt < std::chrono::seconds(PIPELINE_IDLE_TIMEOUT_SEC) ) {
+        if ( sinkerTransport.receiveView(message, 1) and pending.erase(sink.consume(message)) ) {
+            progressAt = std::chrono::steady_clock::now();
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    run = 0;
+    for ( auto& stage : stages ) {
+        stage.join();
+    }
+
+    if ( not pending.empty() ) {
+        std::cerr << "Error: " << pending.size() << " task(s) never finished:";
+        for ( int taskId : pending ) { std::cerr << ' ' << taskId; }
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    std::cout << "Processed " << textNames.size() << " text(s) with " << workersCount
+              << " worker(s) in " << elapsed.count() << " ms" << std::endl;
+    return 0;
+}
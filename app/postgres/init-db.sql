@@ -1,18 +1,172 @@
+-- Creates the schema on a fresh volume, and brings the schema of any earlier
+-- build up to date. The container runs this only when it initializes a new
+-- volume; apply it to an existing postgres_data volume with
+--   docker compose exec -T postgres psql -U user -d textdb -v ON_ERROR_STOP=1 -1 < postgres/init-db.sql
+-- or recreate the volume with `docker compose down -v`. Every statement can
+-- be run again.
+
 CREATE TABLE IF NOT EXISTS texts (
     id SERIAL PRIMARY KEY,
-    name VARCHAR(255) NOT NULL,
+    name VARCHAR(255) NOT NULL UNIQUE,
+    -- SHA-256 of the file the text was loaded from; a reload of the same
+    -- bytes is skipped.
+    content_hash BYTEA,
+    section_count INTEGER NOT NULL DEFAULT 0,
+    total_bytes BIGINT NOT NULL DEFAULT 0,
+    storage VARCHAR(16) NOT NULL DEFAULT 'text',
+    stats_ready BOOLEAN NOT NULL DEFAULT FALSE,
     created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
 );
 
+ALTER TABLE texts
+    ADD COLUMN IF NOT EXISTS content_hash BYTEA,
+    ADD COLUMN IF NOT EXISTS section_count INTEGER NOT NULL DEFAULT 0,
+    ADD COLUMN IF NOT EXISTS total_bytes BIGINT NOT NULL DEFAULT 0,
+    ADD COLUMN IF NOT EXISTS storage VARCHAR(16) NOT NULL DEFAULT 'text',
+    ADD COLUMN IF NOT EXISTS stats_ready BOOLEAN NOT NULL DEFAULT FALSE;
+
+-- Earlier loaders added a text again on every run; the latest copy of each
+-- name is kept. The index is the one backing the UNIQUE constraint above.
+DELETE FROM texts t USING texts newer WHERE newer.name = t.name AND newer.id > t.id;
+CREATE UNIQUE INDEX IF NOT EXISTS texts_name_key ON texts(name);
+DROP INDEX IF EXISTS idx_texts_name;
+
+-- Section contents are stored once per distinct content, keyed by its
+-- SHA-256; sections map a text's section numbers onto them.
+CREATE TABLE IF NOT EXISTS section_contents (
+    hash BYTEA PRIMARY KEY,
+    -- Octet length of the unpacked content, whichever column holds it.
+    bytes INTEGER NOT NULL,
+    content TEXT,
+    -- zstd frame of the content, set instead of it for sections first loaded
+    -- with storage 'zstd'. Frames are already compressed, so TOAST leaves them be.
+    packed BYTEA,
+    CONSTRAINT section_content CHECK ((content IS NULL) <> (packed IS NULL))
+);
+
+ALTER TABLE section_contents ADD COLUMN IF NOT EXISTS bytes INTEGER;
+UPDATE section_contents SET bytes = coalesce(octet_length(content), octet_length(packed)) WHERE bytes IS NULL;
+ALTER TABLE section_contents ALTER COLUMN bytes SET NOT NULL;
+ALTER TABLE section_contents ALTER COLUMN packed SET STORAGE EXTERNAL;
+
+-- Sections used to hold their content, or its zstd frame in packed. Contents
+-- move to section_contents under their SHA-256, as the loader computes it.
+-- Frames can't be unpacked here, so packed ones go under the hash and size
+-- of the frame; they are still deduplicated, only not against plain ones.
+-- Section counts are reset for the splitter to recount.
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM information_schema.columns
+               WHERE table_schema = current_schema() AND table_name = 'sections' AND column_name = 'content') THEN
+        ALTER TABLE sections ADD COLUMN IF NOT EXISTS packed BYTEA;
+        ALTER TABLE sections ADD COLUMN IF NOT EXISTS content_hash BYTEA;
+
+        UPDATE sections SET content_hash = coalesce(sha256(convert_to(content, 'UTF8')), sha256(packed));
+        INSERT INTO section_contents (hash, bytes, content, packed)
+            SELECT DISTINCT ON (content_hash) content_hash, coalesce(octet_length(content), octet_length(packed)),
+                   content, packed
+            FROM sections
+            ON CONFLICT (hash) DO NOTHING;
+
+        ALTER TABLE sections
+            DROP CONSTRAINT IF EXISTS section_content,
+            DROP COLUMN content,
+            DROP COLUMN packed,
+            ALTER COLUMN content_hash SET NOT NULL,
+            ADD FOREIGN KEY (content_hash) REFERENCES section_contents(hash);
+        UPDATE texts SET section_count = 0, total_bytes = 0;
+    END IF;
+END
+$$;
+
 CREATE TABLE IF NOT EXISTS sections (
     id SERIAL PRIMARY KEY,
     text_id INTEGER NOT NULL REFERENCES texts(id) ON DELETE CASCADE,
-    content TEXT NOT NULL,
     section_number INTEGER NOT NULL,
+    content_hash BYTEA NOT NULL REFERENCES section_contents(hash),
     created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
     CONSTRAINT unique_text_section UNIQUE (text_id, section_number)
 );
 
+-- Per-content partial results written by `loader --stats`, keyed like the
+-- content itself so they always describe the bytes they are joined to, even
+-- across reloads. tokens holds "word count ..." pairs in order of first
+-- occurrence, sentence_spans the flattened (offset, length) of each trimmed
+-- sentence in the content. Partials once keyed by (text_id, section_number)
+-- are dropped; `loader --stats` computes them again.
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM information_schema.columns
+               WHERE table_schema = current_schema() AND table_name = 'section_stats' AND column_name = 'text_id') THEN
+        DROP TABLE section_stats;
+        UPDATE texts SET stats_ready = FALSE;
+    END IF;
+END
+$$;
+
+CREATE TABLE IF NOT EXISTS section_stats (
+    content_hash BYTEA PRIMARY KEY REFERENCES section_contents(hash),
+    words_count INTEGER NOT NULL,
+    positive_count INTEGER NOT NULL,
+    negative_count INTEGER NOT NULL,
+    tokens TEXT NOT NULL,
+    sentence_spans INTEGER[] NOT NULL
+);
+
 CREATE INDEX IF NOT EXISTS idx_sections_text_id ON sections(text_id);
 CREATE INDEX IF NOT EXISTS idx_sections_section_number ON sections(section_number);
-CREATE INDEX IF NOT EXISTS idx_texts_name ON texts(name);
+
+-- Tasks and batch plans of builds that named texts and listed section ids are
+-- dropped, unfinished ones included.
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM information_schema.columns
+               WHERE table_schema = current_schema() AND table_name = 'tasks' AND column_name = 'text_name')
+       OR EXISTS (SELECT 1 FROM information_schema.columns
+                  WHERE table_schema = current_schema() AND table_name = 'task_batches' AND column_name = 'section_ids') THEN
+        DROP TABLE IF EXISTS task_batches;
+        DROP TABLE tasks;
+    END IF;
+END
+$$;
+
+-- Tasks get their ids from the sequence, so any number of splitters can run
+-- and restart. A task stays 'publishing' until every batch is published.
+CREATE TABLE IF NOT EXISTS tasks (
+    id SERIAL PRIMARY KEY,
+    text_id INTEGER NOT NULL REFERENCES texts(id) ON DELETE CASCADE,
+    tenant VARCHAR(255) NOT NULL DEFAULT 'default',
+    priority INTEGER NOT NULL DEFAULT 0,
+    total_sections INTEGER NOT NULL,
+    start_time BIGINT NOT NULL,
+    -- texts.content_hash when the task was registered, the key its result
+    -- is cached under.
+    content_hash BYTEA,
+    -- 'publishing', 'published', 'completed' or 'failed' once aggregated,
+    -- or 'cached' when the result was replayed from result_cache.
+    status VARCHAR(16) NOT NULL DEFAULT 'publishing',
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+);
+
+ALTER TABLE tasks ADD COLUMN IF NOT EXISTS content_hash BYTEA;
+
+CREATE TABLE IF NOT EXISTS task_batches (
+    task_id INTEGER NOT NULL REFERENCES tasks(id) ON DELETE CASCADE,
+    first_section INTEGER NOT NULL,
+    last_section INTEGER NOT NULL,
+    published BOOLEAN NOT NULL DEFAULT FALSE,
+    PRIMARY KEY (task_id, first_section)
+);
+
+-- Final aggregated results by text content and analysis parameters
+-- (RESULT_CACHE_PARAMS), as ResultMessage JSON.
+CREATE TABLE IF NOT EXISTS result_cache (
+    content_hash BYTEA NOT NULL,
+    params VARCHAR(255) NOT NULL,
+    payload TEXT NOT NULL,
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    PRIMARY KEY (content_hash, params)
+);
+
+CREATE INDEX IF NOT EXISTS idx_tasks_publishing ON tasks(id) WHERE status = 'publishing';
+CREATE INDEX IF NOT EXISTS idx_tasks_unfinished ON tasks(text_id) WHERE status IN ('publishing', 'published');
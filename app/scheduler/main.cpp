@@ -0,0 +1,31 @@
+#include <atomic>
+#include <iostream>
+#include <csignal>
+
+#include "constants.hpp"
+#include "rabbitmq.hpp"
+#include "scheduler.hpp"
+
+static std::atomic<int> run = 1;
+
+static void stop(int sig) {
+    run = 0;
+}
+
+int main(int argc, char* argv[]) {
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    RabbitMQ rmq;
+
+    if ( not rmq.connect(RABBITMQ_HOST, RABBITMQ_PORT, RABBITMQ_USER, RABBITMQ_PASSWORD) ) {
+        std::cerr << "Error: Cannot connect to RabbitMQ" << std::endl;
+        return 1;
+    }
+
+    if ( not rmq.setCompression(COMPRESSION_CODEC, COMPRESSION_THRESHOLD, COMPRESSION_DICTIONARY_PATH) ) {
+        std::cerr << "Warning: Compression is unavailable, publishing uncompressed" << std::endl;
+    }
+
+    return runScheduler(rmq, run);
+}
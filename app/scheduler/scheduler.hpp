@@ -0,0 +1,446 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "constants.hpp"
+#include "messages.hpp"
+#include "routing.hpp"
+#include "streaming.hpp"
+#include "transport.hpp"
+
+// Feeds QUEUE_NAME from the tenant lanes by weighted round-robin. The priority
+// lane gets PRIORITY_LANE_WEIGHT turns per round, each tenant lane one, and
+// QUEUE_NAME is kept at most SCHEDULER_MAX_QUEUED deep. A big task therefore
+// only ever has a few batches ahead of the next small one. With the lanes
+// disabled QUEUE_NAME is the only lane, which pull mode then drains.
+//
+// With WORKER_GROUPS set, batches go to their text's group queue instead,
+// while it has room and consumers; QUEUE_NAME takes the overflow.
+class Scheduler {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Lane {
+        std::string queueName;
+        int weight;
+    };
+
+    struct Group {
+        std::string queueName;
+        long queued{0};
+        bool open{true};
+    };
+
+    // Group queue depths are re-read this often; in between they are only
+    // counted up locally, so a group looks full rather than empty.
+    static constexpr std::chrono::milliseconds groupRefresh{100};
+
+    Transport& transport_;
+    std::vector<Lane> lanes_;
+    size_t cursor_{0};
+    int credit_{0};
+    std::string message_;
+    std::vector<Group> groups_;
+    routing::AffinityRing ring_{0};
+    Clock::time_point refreshedAt_{};
+    // A batch taken from its lane that has nowhere to go yet.
+    bool held_{false};
+
+    // Re-reads the group queues and hands batches stranded in a group
+    // without consumers back to QUEUE_NAME.
+    void refreshGroups()
+    {
+        auto now = Clock::now();
+        if ( now - refreshedAt_ < groupRefresh ) { return; }
+        refreshedAt_ = now;
+
+        std::string stranded;
+        for ( auto& group : groups_ ) {
+            long consumers = transport_.consumerCount(group.queueName);
+            group.open = consumers != 0;
+            if ( not group.open ) {
+                while ( transport_.getMessage(group.queueName, stranded) ) {
+                    transport_.sendMessage(stranded, QUEUE_NAME);
+                }
+            }
+            group.queued = transport_.messageCount(group.queueName);
+        }
+    }
+
+    // The batch's group queue, or QUEUE_NAME when that group is full or
+    // nobody consumes it.
+    const std::string& destinationFor(const std::string& message)
+    {
+        if ( groups_.empty() ) { return QUEUE_NAME; }
+
+        auto& group = groups_[ring_.groupFor(messages::TaskMessage::textIdOf(message))];
+        if ( not group.open or group.queued >= GROUP_MAX_QUEUED ) { return QUEUE_NAME; }
+        ++group.queued;
+        return group.queueName;
+    }
+
+public:
+    explicit Scheduler(Transport& transport) : transport_(transport)
+    {
+        if ( not SCHEDULER_ENABLED ) {
+            lanes_.push_back({QUEUE_NAME, 1});
+            return;
+        }
+
+        lanes_.push_back({PRIORITY_QUEUE_NAME, PRIORITY_LANE_WEIGHT});
+        for ( int lane = 0; lane < TENANT_LANES; ++lane ) {
+            lanes_.push_back({routing::laneQueueName(lane), 1});
+        }
+
+        if ( WORKER_GROUPS > 0 and WORK_DISTRIBUTION == "push" ) {
+            ring_ = routing::AffinityRing{WORKER_GROUPS};
+            for ( int group = 0; group < WORKER_GROUPS; ++group ) {
+                groups_.push_back({routing::groupQueueName(group)});
+            }
+        }
+    }
+
+    bool declareQueues()
+    {
+        for ( const auto& lane : lanes_ ) {
+            if ( not transport_.declareQueue(lane.queueName) ) { return false; }
+        }
+        for ( const auto& group : groups_ ) {
+            if ( not transport_.declareQueue(group.queueName) ) { return false; }
+        }
+        return transport_.declareQueue(QUEUE_NAME);
+    }
+
+    // Takes the next batch in weighted round-robin order; false when every
+    // lane is empty.
+    bool take(std::string& message)
+    {
+        for ( size_t emptyLanes = 0; emptyLanes < lanes_.size(); ) {
+            const auto& lane = lanes_[cursor_];
+            if ( credit_ == 0 ) { credit_ = lane.weight; }
+
+            bool taken = transport_.getMessage(lane.queueName, message);
+            if ( taken ) {
+                --credit_;
+            } else {
+                credit_ = 0;
+                ++emptyLanes;
+            }
+
+            if ( credit_ == 0 ) { cursor_ = (cursor_ + 1) % lanes_.size(); }
+            if ( taken ) { return true; }
+        }
+
+        return false;
+    }
+
+    // Forwards batches while QUEUE_NAME has budget left, or while their group
+    // queues take them, and returns how many were forwarded.
+    long dispatch(long budget)
+    {
+        if ( not groups_.empty() ) { refreshGroups(); }
+
+        long forwarded = 0;
+        long shared = 0;
+        while ( held_ or take(message_) ) {
+            held_ = true;
+
+            const auto& queueName = destinationFor(message_);
+            if ( queueName == QUEUE_NAME ) {
+                if ( shared == budget ) { break; }
+                ++shared;
+            }
+
+            transport_.sendMessage(message_, queueName);
+            held_ = false;
+            ++forwarded;
+        }
+
+        return forwarded;
+    }
+};
+
+// Serves pull-mode work requests. Each worker gets the head of the next
+// batch, cut to what it processes in about PULL_TARGET_SECONDS at its
+// reported rate; the rest of the batch goes to whoever asks next. Fast
+// workers thus take large pieces and slow ones small pieces, and a task's
+// last ranges are spread over everyone instead of waiting on one straggler.
+// Requests that find no work wait here until some arrives.
+//
+// Every assignment stays outstanding until a worker reports it done. One
+// that runs past the speculation deadline is handed again to the next other
+// worker that asks, ahead of new work; the aggregator keeps whichever result
+// arrives first. After SPECULATION_MAX_ISSUES issues the batch is given up
+// and reported failed, so its task finishes.
+class Coordinator {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Outstanding {
+        std::string message;
+        std::string workerId;
+        // Of the latest issue.
+        Clock::time_point issuedAt;
+        int sections;
+        int issues{1};
+    };
+
+    static constexpr size_t latencyWindow = 256;
+
+    Transport& transport_;
+    Scheduler& scheduler_;
+    std::deque<messages::TaskMessage> remainders_;
+    std::deque<messages::WorkRequest> waiting_;
+    std::unordered_map<uint64_t, Outstanding> outstanding_;
+    std::deque<double> latencies_;
+    double secondsPerSection_{0};
+    Clock::time_point sweptAt_{};
+    std::string message_;
+
+    static uint64_t batchKey(int taskId, int firstSection)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(taskId)) << 32) | static_cast<uint32_t>(firstSection);
+    }
+
+    void recordLatency(double secondsPerSection)
+    {
+        latencies_.push_back(secondsPerSection);
+        if ( latencies_.size() > latencyWindow ) { latencies_.pop_front(); }
+
+        std::vector<double> sorted(latencies_.begin(), latencies_.end());
+        auto nth = sorted.begin() + static_cast<size_t>(SPECULATION_PERCENTILE * (sorted.size() - 1));
+        std::nth_element(sorted.begin(), nth, sorted.end());
+        secondsPerSection_ = *nth;
+    }
+
+    std::chrono::duration<double> deadlineFor(int sections) const
+    {
+        if ( latencies_.size() < SPECULATION_MIN_SAMPLES ) {
+            return std::chrono::duration<double>(SPECULATION_FALLBACK_SECONDS);
+        }
+        return std::chrono::duration<double>(
+            std::max(SPECULATION_MIN_SECONDS, SPECULATION_FACTOR * secondsPerSection_ * sections));
+    }
+
+    void complete(const messages::WorkRequest& request)
+    {
+        auto now = Clock::now();
+        for ( const auto& [taskId, firstSection] : request.completed ) {
+            auto it = outstanding_.find(batchKey(taskId, firstSection));
+            if ( it == outstanding_.end() ) { continue; }
+
+            // A re-issued batch's time says nothing about a healthy worker.
+            if ( it->second.issues == 1 ) {
+                std::chrono::duration<double> elapsed = now - it->second.issuedAt;
+                recordLatency(elapsed.count() / std::max(it->second.sections, 1));
+            }
+            outstanding_.erase(it);
+        }
+    }
+
+    // Each issue gets twice the deadline of the one before.
+    bool expired(const Outstanding& batch, Clock::time_point now) const
+    {
+        return now - batch.issuedAt > deadlineFor(batch.sections) * (1 << (batch.issues - 1));
+    }
+
+    // An overdue batch that may be issued again and belongs to another worker.
+    Outstanding* overdue(const std::string& workerId)
+    {
+        auto now = Clock::now();
+        for ( auto& [key, batch] : outstanding_ ) {
+            if ( batch.issues >= SPECULATION_MAX_ISSUES or batch.workerId == workerId ) { continue; }
+            if ( expired(batch, now) ) { return &batch; }
+        }
+        return nullptr;
+    }
+
+    // Reports batches past their last deadline as failed and forgets them.
+    // Runs about once a second.
+    void abandonExpired()
+    {
+        auto now = Clock::now();
+        if ( now - sweptAt_ < std::chrono::seconds(1) ) { return; }
+        sweptAt_ = now;
+
+        for ( auto it = outstanding_.begin(); it != outstanding_.end(); ) {
+            auto& batch = it->second;
+            if ( batch.issues < SPECULATION_MAX_ISSUES or not expired(batch, now) ) {
+                ++it;
+                continue;
+            }
+
+            auto task = messages::TaskMessage::fromJson(batch.message);
+            std::cerr << "Error: Giving up batch of task " << task.taskId << " (sections " << task.firstSection
+                      << "-" << task.lastSection << ") after " << batch.issues << " issues" << std::endl;
+            auto failed = messages::ResultMessage::failedBatch(task);
+            if ( not streaming::sendResult(transport_, routing::resultsQueueFor(task.taskId), failed, message_) ) {
+                std::cerr << "Error: Cannot report failed batch of task " << task.taskId << std::endl;
+            }
+            it = outstanding_.erase(it);
+        }
+    }
+
+    bool nextBatch(messages::TaskMessage& task)
+    {
+        if ( not remainders_.empty() ) {
+            task = std::move(remainders_.front());
+            remainders_.pop_front();
+            return true;
+        }
+
+        if ( not scheduler_.take(message_) ) { return false; }
+        task = messages::TaskMessage::fromJson(message_);
+        return true;
+    }
+
+    static int assignmentSize(const messages::WorkRequest& request)
+    {
+        return std::max(PULL_MIN_SECTIONS, static_cast<int>(request.sectionsPerSecond * PULL_TARGET_SECONDS));
+    }
+
+    // Keeps everything past the first size sections of task for later.
+    void carve(messages::TaskMessage& task, int size)
+    {
+        // Splitting off less than a minimal piece is not worth a message.
+        if ( task.lastSection - task.firstSection + 1 < size + PULL_MIN_SECTIONS ) { return; }
+
+        int count = task.lastSection - task.firstSection + 1;
+        // Pushed contents that don't line up with the range are dropped and
+        // fetched by the worker instead.
+        if ( task.sections.size() != static_cast<size_t>(count) ) { task.sections.clear(); }
+
+        messages::TaskMessage rest = task;
+        rest.sections.clear();
+        rest.firstSection = task.firstSection + size;
+        task.lastSection = rest.firstSection - 1;
+
+        if ( not task.sections.empty() ) {
+            rest.sections.assign(std::make_move_iterator(task.sections.begin() + size),
+                                 std::make_move_iterator(task.sections.end()));
+            task.sections.resize(size);
+        }
+
+        remainders_.push_front(std::move(rest));
+    }
+
+    // Sends the worker its next assignment; returns false if there is none.
+    bool serve(const messages::WorkRequest& request)
+    {
+        auto queueName = routing::workerQueueName(request.workerId);
+
+        if ( auto* late = overdue(request.workerId) ) {
+            std::cout << "[SPECULATE] Re-issued a batch of " << late->workerId
+                      << " to " << request.workerId << std::endl;
+            ++late->issues;
+            late->workerId = request.workerId;
+            late->issuedAt = Clock::now();
+            transport_.sendMessage(late->message, queueName);
+            return true;
+        }
+
+        messages::TaskMessage task;
+        if ( not nextBatch(task) ) { return false; }
+
+        carve(task, assignmentSize(request));
+        auto& batch = outstanding_[batchKey(task.taskId, task.firstSection)];
+        batch = Outstanding{task.toJson(), request.workerId, Clock::now(), task.lastSection - task.firstSection + 1};
+        transport_.sendMessage(batch.message, queueName);
+        return true;
+    }
+
+    void park(messages::WorkRequest&& request)
+    {
+        // A repeated request replaces the one the worker sent before.
+        for ( auto& waiting : waiting_ ) {
+            if ( waiting.workerId == request.workerId ) {
+                waiting = std::move(request);
+                return;
+            }
+        }
+        waiting_.push_back(std::move(request));
+    }
+
+public:
+    Coordinator(Transport& transport, Scheduler& scheduler) : transport_(transport), scheduler_(scheduler) {}
+
+    bool declareQueues()
+    {
+        return transport_.declareQueue(WORK_REQUESTS_QUEUE_NAME);
+    }
+
+    // Serves waiting requests, then new ones. Returns whether anything happened.
+    bool step()
+    {
+        bool progress = false;
+        abandonExpired();
+
+        while ( not waiting_.empty() ) {
+            if ( not serve(waiting_.front()) ) { break; }
+            waiting_.pop_front();
+            progress = true;
+        }
+
+        while ( transport_.getMessage(WORK_REQUESTS_QUEUE_NAME, message_) ) {
+            auto request = messages::WorkRequest::fromJson(message_);
+            complete(request);
+            if ( not serve(request) ) { park(std::move(request)); }
+            progress = true;
+        }
+
+        return progress;
+    }
+};
+
+inline int runScheduler(Transport& transport, const std::atomic<int>& run)
+{
+    Scheduler scheduler{transport};
+
+    if ( not scheduler.declareQueues() ) {
+        std::cerr << "Error: Cannot declare scheduler queues" << std::endl;
+        return 1;
+    }
+
+    if ( WORK_DISTRIBUTION == "pull" ) {
+        Coordinator coordinator{transport, scheduler};
+        if ( not coordinator.declareQueues() ) {
+            std::cerr << "Error: Cannot declare work requests queue" << std::endl;
+            return 1;
+        }
+
+        std::cout << "Scheduler started in pull mode." << std::endl;
+
+        while ( run ) {
+            if ( not coordinator.step() ) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        }
+
+        std::cout << "Shutting down scheduler..." << std::endl;
+        return 0;
+    }
+
+    std::cout << "Scheduler started." << std::endl;
+
+    while ( run ) {
+        long queued = transport.messageCount(QUEUE_NAME);
+        long budget = queued < 0 ? 1 : std::max(0L, SCHEDULER_MAX_QUEUED - queued);
+
+        if ( scheduler.dispatch(budget) == 0 ) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    std::cout << "Shutting down scheduler..." << std::endl;
+    return 0;
+}
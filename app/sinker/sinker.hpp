@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "constants.hpp"
+#include "messages.hpp"
+#include "transport.hpp"
+
+inline void writeResultHead(std::ofstream& file, const messages::ResultMessage& result)
+{
+    file << "========================================\n";
+    file << "AGGREGATED RESULT FOR TASK " << result.taskId << '\n';
+    file << "Sections processed: " << result.totalSections - result.failedSections << " / " << result.totalSections << '\n';
+    if ( result.failedSections > 0 ) { file << "FAILED: results of " << result.failedSections << " sections were lost\n"; }
+    file << "----------------------------------------\n";
+
+    file << "Words count: " << result.wordsCount << '\n';
+    file << '\n';
+
+    file << "Top 1000 words:\n";
+    for ( const auto& nw : result.topWords ) {
+        file << nw.second << ": " << nw.first << '\n';
+    }
+    file << '\n';
+
+    file << "Sorted sentences:\n";
+}
+
+inline void writeSentences(std::ofstream& file, const std::vector<std::pair<size_t, std::string>>& sentences)
+{
+    for ( const auto& sent : sentences ) {
+        file << sent.second << " (" << sent.first << ")\n";
+    }
+}
+
+inline void writeTextHeading(std::ofstream& file, int tonality)
+{
+    file << '\n';
+
+    std::string tonalityStr = "neutral";
+    if ( tonality > 0 ) { tonalityStr = "positive"; }
+    else if ( tonality < 0 ) { tonalityStr = "negative"; }
+    file << "Tonality: " <<  tonalityStr << '\n';
+    file << '\n';
+
+    file << "Text with replacements: ";
+}
+
+inline void writeResultTail(std::ofstream& file)
+{
+    file << '\n';
+    file << "========================================" << std::endl;
+}
+
+inline void formatResultForFile(std::ofstream& file, const messages::ResultMessage& result)
+{
+    writeResultHead(file, result);
+    writeSentences(file, result.sortedSentences);
+    writeTextHeading(file, result.tonality);
+    file << result.replacedText;
+    writeResultTail(file);
+}
+
+// Writes aggregated results to resultsDir. Chunked results are written as
+// their chunks arrive, so only the open file is held per stream.
+class ResultSink {
+private:
+    struct Stream {
+        int taskId;
+        int tonality;
+        std::ofstream file;
+        bool textStarted{false};
+        int nextSeq{0};
+        bool failed{false};
+    };
+
+    std::filesystem::path resultsDir_;
+    std::unordered_map<long, Stream> streams_;
+
+    std::filesystem::path pathFor(int taskId) const
+    {
+        return resultsDir_ / ("task_" + std::to_string(taskId) + ".txt");
+    }
+
+    static void reportEnd(int taskId, bool failed = false)
+    {
+        auto endTime = std::chrono::system_clock::now();
+        auto timeT = std::chrono::system_clock::to_time_t(endTime);
+        auto* tmPtr = std::localtime(&timeT);
+
+        std::ostringstream timeStr;
+        timeStr << std::put_time(tmPtr, "%Y-%m-%d %H:%M:%S");
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            endTime.time_since_epoch()) % 1000;
+        timeStr << "." << std::setfill('0') << std::setw(3) << ms.count();
+
+        std::cout << "[TASK END] Task " << taskId << (failed ? " failed at " : " completed at ") << timeStr.str()
+                  << std::endl;
+    }
+
+    int consumeChunk(messages::ResultChunk&& chunk)
+    {
+        auto it = streams_.find(chunk.streamId);
+        if ( it == streams_.end() ) { return 0; }
+
+        // Duplicates are dropped; after a gap the file would be truncated or
+        // out of order, so it is removed and the task is reported failed.
+        auto& stream = it->second;
+        if ( chunk.seq < stream.nextSeq ) { return 0; }
+        if ( chunk.seq > stream.nextSeq ) {
+            int taskId = stream.taskId;
+            std::cerr << "Error: Lost chunk " << stream.nextSeq << " of task " << taskId
+                      << ", discarding its result" << std::endl;
+            stream.file.close();
+            std::filesystem::remove(pathFor(taskId));
+            streams_.erase(it);
+            reportEnd(taskId, true);
+            return taskId;
+        }
+        ++stream.nextSeq;
+
+        writeSentences(stream.file, chunk.sortedSentences);
+        if ( not chunk.text.empty() or chunk.last ) {
+            if ( not stream.textStarted ) {
+                writeTextHeading(stream.file, stream.tonality);
+                stream.textStarted = true;
+            }
+            stream.file << chunk.text;
+        }
+
+        if ( not chunk.last ) { return 0; }
+
+        int taskId = stream.taskId;
+        bool failed = stream.failed;
+        writeResultTail(stream.file);
+        streams_.erase(it);
+        reportEnd(taskId, failed);
+        return taskId;
+    }
+
+public:
+    explicit ResultSink(std::filesystem::path resultsDir) : resultsDir_(std::move(resultsDir))
+    {
+        if ( not std::filesystem::exists(resultsDir_) ) { std::filesystem::create_directories(resultsDir_); }
+    }
+
+    // Returns the task id once its result is completely written or has
+    // failed, 0 otherwise.
+    int consume(std::string_view message)
+    {
+        if ( messages::ResultChunk::isChunk(message) ) {
+            return consumeChunk(messages::ResultChunk::fromJson(message));
+        }
+
+        auto result = messages::ResultMessage::fromJson(message);
+
+        if ( result.chunked ) {
+            Stream stream{result.taskId, result.tonality, std::ofstream(pathFor(result.taskId))};
+            stream.failed = result.failedSections > 0;
+            writeResultHead(stream.file, result);
+            streams_.emplace(result.streamId, std::move(stream));
+            return 0;
+        }
+
+        if ( std::ofstream file(pathFor(result.taskId)); file.is_open() ) { formatResultForFile(file, result); }
+        reportEnd(result.taskId, result.failedSections > 0);
+        return result.taskId;
+    }
+};
+
+inline int runSinker(Transport& transport, const std::filesystem::path& resultsDir, const std::atomic<int>& run)
+{
+    if ( not transport.declareQueue(SINKER_QUEUE_NAME) ) {
+        std::cerr << "Error: Cannot declare sinker queue" << std::endl;
+        return 1;
+    }
+
+    if ( not transport.startConsuming(SINKER_QUEUE_NAME) ) {
+        std::cerr << "Error: Cannot start consuming" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Sinker started." << std::endl;
+
+    ResultSink sink{resultsDir};
+    std::string_view message;
+
+    while ( run ) {
+        if ( transport.receiveView(message, 1) ) {
+            sink.consume(message);
+        }
+    }
+
+    std::cout << "Shutting down sinker..." << std::endl;
+    return 0;
+}
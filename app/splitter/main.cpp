@@ -1,91 +1,82 @@
 #include <chrono>
-#include <iomanip>
 #include <iostream>
-#include <optional>
+#include <memory>
 #include <pqxx/pqxx>
 #include <sstream>
 #include <string>
+#include <vector>
 
+#include "args.hpp"
 #include "constants.hpp"
-#include "messages.hpp"
 #include "rabbitmq.hpp"
+#include "splitter.hpp"
 
-static int taskIdCounter = 1;
+static void printUsage() {
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  list        - List all texts" << std::endl;
+    std::cout << "  <text_name> [tenant] [interactive] - Start processing a text" << std::endl;
+}
 
-static void listTexts(pqxx::connection& conn) {
-    pqxx::work txn(conn);
-    
-    auto result = txn.exec("SELECT name FROM texts ORDER BY name");
-    for ( const auto& row : result ) {
-        std::cout << "  - " << row[0].as<std::string>() << std::endl;
-    }
+static void printBulkUsage() {
+    std::cout << "Usage: splitter [-j <jobs>] [-t <tenant>] (--all | --like <pattern> | <text_name>...)" << std::endl;
 }
 
-static std::vector<int> getSectionIds(pqxx::connection& conn, const std::string& textName) {
-    std::vector<int> sectionIds;
-    sectionIds.reserve(128);
-    pqxx::work txn(conn);
-    
-    auto result = txn.exec_params(
-        "SELECT s.id FROM sections s "
-        "JOIN texts t ON s.text_id = t.id "
-        "WHERE t.name = $1 "
-        "ORDER BY s.section_number",
-        textName
-    );
-    
-    for ( const auto& row : result ) {
-        sectionIds.push_back(row[0].as<int>());
+static std::unique_ptr<Transport> connectTransport() {
+    auto rmq = std::make_unique<RabbitMQ>();
+    if ( not rmq->connect(RABBITMQ_HOST, RABBITMQ_PORT, RABBITMQ_USER, RABBITMQ_PASSWORD) ) {
+        std::cerr << "Error: Cannot connect to RabbitMQ" << std::endl;
+        return nullptr;
     }
-    
-    return sectionIds;
+    rmq->setCompression(COMPRESSION_CODEC, COMPRESSION_THRESHOLD, COMPRESSION_DICTIONARY_PATH);
+    return rmq;
 }
 
-static void createTask(pqxx::connection& dbConn, RabbitMQ& rmq, const std::string& textName) {
-    int taskId = taskIdCounter++;
-    auto sectionIds = getSectionIds(dbConn, textName);
-    
-    if ( sectionIds.empty()) {
-        std::cerr << "No sections found for text: " << textName << std::endl;
-        return;
-    }
-    
-    int totalSections = sectionIds.size();
-    
-    auto startTime = std::chrono::system_clock::now();
-    auto timeT = std::chrono::system_clock::to_time_t(startTime);
-    auto* tmPtr = std::localtime(&timeT);
-    
-    std::ostringstream timeStr;
-    timeStr << std::put_time(tmPtr, "%Y-%m-%d %H:%M:%S");
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-        startTime.time_since_epoch()).count();
-    timeStr << "." << std::setfill('0') << std::setw(3) << ms % 1'000;
-    
-    std::cout << "[TASK START] Task " << taskId << " started at " << timeStr.str() 
-              << " for text: " << textName << std::endl;
-    
-    for ( size_t i = 0; i < sectionIds.size(); i += BATCH_SIZE ) {
-        messages::TaskMessage msg;
-        msg.taskId = taskId;
-        msg.totalSections = totalSections;
-        msg.startTime = ms;
-        for ( size_t j = i; j < i + BATCH_SIZE and j < sectionIds.size(); ++j ) {
-            msg.sectionIds.push_back(sectionIds[j]);
+// Submits every text named on the command line, or matched by --all/--like,
+// and exits.
+static int runBulk(pqxx::connection& conn, int argc, char* argv[]) {
+    int jobs = SPLITTER_JOBS;
+    std::string tenant = "default";
+    std::vector<std::string> textNames;
+
+    for ( int i = 1; i < argc; ++i ) {
+        std::string arg = argv[i];
+        if ( arg == "-j" and i + 1 < argc ) {
+            if ( not args::parseInt(argv[++i], jobs, 1) ) {
+                printBulkUsage();
+                return 1;
+            }
+        } else if ( arg == "-t" and i + 1 < argc ) {
+            tenant = argv[++i];
+        } else if ( arg == "--all" ) {
+            auto names = findTexts(conn, "%");
+            textNames.insert(textNames.end(), names.begin(), names.end());
+        } else if ( arg == "--like" and i + 1 < argc ) {
+            auto names = findTexts(conn, argv[++i]);
+            textNames.insert(textNames.end(), names.begin(), names.end());
+        } else if ( not arg.empty() and arg[0] != '-' ) {
+            textNames.push_back(arg);
+        } else {
+            printBulkUsage();
+            return 1;
         }
-        
-        // std::cout << msg.toJson() << std::endl;
-        rmq.sendMessage(msg.toJson(), QUEUE_NAME);
     }
-}
 
-static void printUsage() {
-    std::cout << "Usage:" << std::endl;
-    std::cout << "  list        - List all texts" << std::endl;
-    std::cout << "  <text_name> - Start processing a text" << std::endl;
+    if ( textNames.empty() ) {
+        std::cerr << "No texts to submit" << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto taskIds = submitTexts(textNames, jobs, tenant, connectTransport);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    std::cout << "Submitted " << taskIds.size() << " of " << textNames.size() << " text(s) in "
+              << elapsed.count() << " ms" << std::endl;
+    return taskIds.size() == textNames.size() ? 0 : 1;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     pqxx::connection conn(DB_CONN_STRING);
     if ( not conn.is_open() ) {
         std::cerr << "Error: Cannot connect to database" << std::endl;
@@ -97,22 +88,32 @@ int main() {
         std::cerr << "Error: Cannot connect to RabbitMQ" << std::endl;
         return 1;
     }
+
+    if ( not rmq.setCompression(COMPRESSION_CODEC, COMPRESSION_THRESHOLD, COMPRESSION_DICTIONARY_PATH) ) {
+        std::cerr << "Warning: Compression is unavailable, publishing uncompressed" << std::endl;
+    }
     
-    if ( not rmq.declareQueue(QUEUE_NAME) ) {
+    if ( not declareSubmitQueues(rmq) ) {
         std::cerr << "Error: Cannot declare queue" << std::endl;
         return 1;
     }
+
+    resumeTasks(conn, rmq);
+
+    if ( argc > 1 ) { return runBulk(conn, argc, argv); }
     
     std::string line;
     while (std::cout << "> " and std::getline(std::cin, line)) {
         std::istringstream iss(line);
         std::string cmd;
-        iss >> cmd;
+        std::string tenant = "default";
+        std::string mode;
+        iss >> cmd >> tenant >> mode;
 
         if ( cmd == "list" ) {
             listTexts(conn);
         } else {
-            createTask(conn, rmq, cmd);
+            createTask(conn, rmq, cmd, tenant, mode == "interactive");
         }
 
         // if ( auto it = commands.find(cmd); it != commands.end() ) {
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <pqxx/pqxx>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "constants.hpp"
+#include "messages.hpp"
+#include "result_cache.hpp"
+#include "routing.hpp"
+#include "sections.hpp"
+#include "streaming.hpp"
+#include "transport.hpp"
+
+// Class key of the session advisory locks a splitter holds while publishing
+// a task; the task id is the object key.
+inline const int TASK_LOCK_CLASS = 1;
+
+inline void listTexts(pqxx::connection& conn) {
+    pqxx::work txn(conn);
+    
+    auto result = txn.exec("SELECT name FROM texts ORDER BY name");
+    for ( const auto& row : result ) {
+        std::cout << "  - " << row[0].as<std::string>() << std::endl;
+    }
+}
+
+// Names of the texts matching a LIKE pattern; "%" matches all of them.
+inline std::vector<std::string> findTexts(pqxx::connection& conn, const std::string& pattern) {
+    std::vector<std::string> names;
+    pqxx::read_transaction txn(conn);
+
+    auto result = txn.exec_params("SELECT name FROM texts WHERE name LIKE $1 ORDER BY name", pattern);
+    for ( const auto& row : result ) {
+        names.push_back(row[0].as<std::string>());
+    }
+
+    return names;
+}
+
+// Per-text metadata the loader stores with the text, so planning a task
+// never touches the sections table.
+struct TextInfo {
+    int id{0};
+    int sectionCount{0};
+    size_t totalBytes{0};
+};
+
+// Text names are unique; a reload of a changed file keeps the id. Texts
+// inserted by init-texts.py carry no metadata and get it on first use.
+inline std::optional<TextInfo> getTextInfo(pqxx::transaction_base& txn, const std::string& textName) {
+    auto result = txn.exec_params(
+        "SELECT id, section_count, total_bytes FROM texts WHERE name = $1 FOR KEY SHARE",
+        textName
+    );
+    if ( result.empty() ) { return std::nullopt; }
+
+    TextInfo info{result[0][0].as<int>(), result[0][1].as<int>(), result[0][2].as<size_t>()};
+    if ( info.sectionCount > 0 ) { return info; }
+
+    auto stats = txn.exec_params(
+        "UPDATE texts SET "
+        "section_count = (SELECT count(*) FROM sections WHERE text_id = $1), "
+        "total_bytes = (SELECT coalesce(sum(c.bytes), 0) FROM sections s "
+        "JOIN section_contents c ON c.hash = s.content_hash WHERE s.text_id = $1) "
+        "WHERE id = $1 RETURNING section_count, total_bytes",
+        info.id
+    );
+    info.sectionCount = stats[0][0].as<int>();
+    info.totalBytes = stats[0][1].as<size_t>();
+    return info;
+}
+
+struct SectionRange {
+    int first;
+    int last;
+};
+
+// Cuts the text into contiguous section ranges of roughly equal cost so that
+// no worker is left with a batch much heavier than the rest. Sections are
+// cut to LOADER_SECTION_BYTES at load time, so equal section counts are
+// roughly equal bytes; only a text's last section may be shorter. Costs are
+// in unpacked bytes, whatever the storage. The batch count follows the
+// number of live workers.
+inline std::vector<SectionRange> planBatches(const TextInfo& text, long consumers) {
+    size_t count = text.sectionCount;
+    size_t totalCost = text.totalBytes + count * SECTION_COST_BYTES;
+
+    size_t target = totalCost / (std::max(consumers, 1L) * BATCHES_PER_CONSUMER);
+    target = std::clamp(target, BATCH_MIN_BYTES, BATCH_MAX_BYTES);
+    size_t batches = std::max<size_t>(1, (totalCost + target - 1) / target);
+    batches = std::max(batches, (count + BATCH_SIZE - 1) / BATCH_SIZE);
+    batches = std::min(batches, count);
+
+    std::vector<SectionRange> ranges;
+    ranges.reserve(batches);
+    for ( size_t k = 0; k < batches; ++k ) {
+        ranges.push_back({static_cast<int>(count * k / batches) + 1, static_cast<int>(count * (k + 1) / batches)});
+    }
+
+    return ranges;
+}
+
+// Live workers by the consumers of the queues they take batches from: the
+// shared queue and the group queues in push mode, the presence queue in
+// pull mode (see pullWork). -1 if the transport cannot count consumers.
+inline long liveWorkers(Transport& transport) {
+    if ( WORK_DISTRIBUTION == "pull" ) { return transport.consumerCount(WORKER_PRESENCE_QUEUE_NAME); }
+
+    long workers = transport.consumerCount(QUEUE_NAME);
+    if ( workers < 0 ) { return -1; }
+    for ( int group = 0; group < WORKER_GROUPS; ++group ) {
+        workers += std::max(transport.consumerCount(routing::groupQueueName(group)), 0L);
+    }
+    return workers;
+}
+
+// The queues liveWorkers counts are declared in either case, since counting
+// the consumers of a missing queue fails. Cached results are replayed to the
+// sinker queue.
+inline bool declareSubmitQueues(Transport& transport) {
+    if ( not transport.declareQueue(QUEUE_NAME) ) { return false; }
+    if ( WORK_DISTRIBUTION == "pull" and not transport.declareQueue(WORKER_PRESENCE_QUEUE_NAME) ) { return false; }
+    for ( int group = 0; group < WORKER_GROUPS; ++group ) {
+        if ( not transport.declareQueue(routing::groupQueueName(group)) ) { return false; }
+    }
+    if ( RESULT_CACHE_ENABLED and not transport.declareQueue(SINKER_QUEUE_NAME) ) { return false; }
+    if ( not SCHEDULER_ENABLED ) { return true; }
+
+    for ( int lane = 0; lane < TENANT_LANES; ++lane ) {
+        if ( not transport.declareQueue(routing::laneQueueName(lane)) ) { return false; }
+    }
+    return transport.declareQueue(PRIORITY_QUEUE_NAME);
+}
+
+// Holds the advisory lock of one task for the lifetime of the session that
+// took it, so a crashed splitter never leaves a task locked.
+class TaskLock {
+private:
+    pqxx::connection& conn_;
+    int taskId_;
+    bool locked_{false};
+
+public:
+    TaskLock(pqxx::connection& conn, int taskId) : conn_(conn), taskId_(taskId)
+    {
+        pqxx::nontransaction txn(conn_);
+        locked_ = txn.exec_params("SELECT pg_try_advisory_lock($1, $2)", TASK_LOCK_CLASS, taskId_)[0][0].as<bool>();
+    }
+
+    ~TaskLock()
+    {
+        if ( not locked_ ) { return; }
+        try {
+            pqxx::nontransaction txn(conn_);
+            txn.exec_params("SELECT pg_advisory_unlock($1, $2)", TASK_LOCK_CLASS, taskId_);
+        } catch ( const std::exception& e ) {
+            std::cerr << "Error: Cannot unlock task " << taskId_ << ": " << e.what() << std::endl;
+        }
+    }
+
+    TaskLock(const TaskLock&) = delete;
+    TaskLock& operator=(const TaskLock&) = delete;
+
+    bool locked() const { return locked_; }
+};
+
+// Records a task and its batch plan in one transaction and returns the task
+// id drawn from the tasks sequence, or 0 if the text is unknown or empty.
+// With a cached result for the text's content, the task is recorded as
+// 'cached' without batches and the result is moved into cachedResult.
+inline int registerTask(pqxx::connection& dbConn, const std::string& textName, const std::string& tenant,
+                        bool interactive, long startTime, long consumers,
+                        std::optional<std::string>* cachedResult = nullptr) {
+    pqxx::work txn(dbConn);
+
+    auto text = getTextInfo(txn, textName);
+    if ( not text or text->sectionCount == 0 ) { return 0; }
+
+    int priority = interactive or text->sectionCount <= SMALL_TASK_SECTIONS ? 1 : 0;
+
+    std::optional<std::string> cached;
+    if ( RESULT_CACHE_ENABLED and cachedResult ) { cached = db::cachedResult(txn, text->id); }
+
+    auto taskId = txn.exec_params(
+        "INSERT INTO tasks (text_id, tenant, priority, total_sections, start_time, content_hash, status) "
+        "SELECT id, $2, $3, $4, $5, content_hash, $6 FROM texts WHERE id = $1 RETURNING id",
+        text->id, tenant, priority, text->sectionCount, startTime, cached ? "cached" : "publishing"
+    )[0][0].as<int>();
+
+    if ( cached ) {
+        txn.commit();
+        *cachedResult = std::move(cached);
+        return taskId;
+    }
+
+    for ( const auto& range : planBatches(*text, consumers) ) {
+        txn.exec_params(
+            "INSERT INTO task_batches (task_id, first_section, last_section) VALUES ($1, $2, $3)",
+            taskId, range.first, range.last
+        );
+    }
+
+    txn.commit();
+    return taskId;
+}
+
+// Publishes the batches of a registered task that are not marked published
+// yet, one transaction per batch, then marks the task published. Returns
+// false if another splitter holds the task or publishing stopped early; the
+// task is then left for resumeTasks. A crash between sending a batch and
+// marking it republishes that one batch, which the aggregator drops.
+inline bool publishTask(pqxx::connection& dbConn, Transport& transport, int taskId) {
+    TaskLock lock{dbConn, taskId};
+    if ( not lock.locked() ) { return false; }
+
+    messages::TaskMessage header;
+    size_t averageBytes = 0;
+    std::vector<SectionRange> batches;
+    {
+        pqxx::read_transaction txn(dbConn);
+
+        auto task = txn.exec_params(
+            "SELECT t.text_id, t.tenant, t.priority, t.total_sections, t.start_time, x.total_bytes "
+            "FROM tasks t JOIN texts x ON x.id = t.text_id "
+            "WHERE t.id = $1 AND t.status = 'publishing'",
+            taskId
+        );
+        if ( task.empty() ) { return true; }
+
+        header.taskId = taskId;
+        header.textId = task[0][0].as<int>();
+        header.tenant = task[0][1].as<std::string>();
+        header.priority = task[0][2].as<int>();
+        header.totalSections = task[0][3].as<int>();
+        header.startTime = task[0][4].as<long>();
+        averageBytes = task[0][5].as<size_t>() / std::max(header.totalSections, 1);
+
+        auto result = txn.exec_params(
+            "SELECT first_section, last_section FROM task_batches "
+            "WHERE task_id = $1 AND NOT published ORDER BY first_section",
+            taskId
+        );
+        for ( const auto& row : result ) {
+            batches.push_back({row[0].as<int>(), row[1].as<int>()});
+        }
+    }
+
+    for ( const auto& range : batches ) {
+        pqxx::work txn(dbConn);
+
+        messages::TaskMessage msg = header;
+        msg.firstSection = range.first;
+        msg.lastSection = range.last;
+        if ( PUSH_SECTIONS and (range.last - range.first + 1) * averageBytes <= PUSH_MAX_BATCH_BYTES ) {
+            // Submissions run on a few long-lived threads; each sets up its
+            // compressor once.
+            static thread_local compression::Compressor compressor = db::sectionCompressor();
+            msg.sections = db::getSectionRange(txn, compressor, msg.textId, range.first, range.last);
+        }
+
+        if ( not transport.sendMessage(msg.toJson(), routing::submitQueueFor(msg)) ) {
+            std::cerr << "Error: Cannot publish batch of task " << taskId << std::endl;
+            return false;
+        }
+
+        txn.exec_params(
+            "UPDATE task_batches SET published = TRUE WHERE task_id = $1 AND first_section = $2",
+            taskId, range.first
+        );
+        txn.commit();
+    }
+
+    pqxx::work txn(dbConn);
+    txn.exec_params("UPDATE tasks SET status = 'published' WHERE id = $1", taskId);
+    txn.commit();
+    return true;
+}
+
+// Sends a cached final result to the sinker as the result of taskId.
+inline bool replayResult(Transport& transport, int taskId, long startTime, const std::string& payload) {
+    auto result = messages::ResultMessage::fromJson(payload);
+    result.taskId = taskId;
+    result.startTime = startTime;
+
+    std::string output;
+    return streaming::sendResult(transport, SINKER_QUEUE_NAME, result, output);
+}
+
+// Registers and publishes one text and returns the new task id, or 0 if the
+// text has no sections. Small or interactive tasks go to the priority lane;
+// texts with a cached result skip the workers altogether.
+inline int createTask(pqxx::connection& dbConn, Transport& transport, const std::string& textName,
+                      const std::string& tenant = "default", bool interactive = false) {
+    auto startTime = std::chrono::system_clock::now();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        startTime.time_since_epoch()).count();
+
+    std::optional<std::string> cachedResult;
+    int taskId = registerTask(dbConn, textName, tenant, interactive, ms, liveWorkers(transport),
+                              &cachedResult);
+    if ( taskId == 0 ) {
+        std::cerr << "No sections found for text: " << textName << std::endl;
+        return 0;
+    }
+    
+    auto timeT = std::chrono::system_clock::to_time_t(startTime);
+    auto* tmPtr = std::localtime(&timeT);
+    
+    std::ostringstream timeStr;
+    timeStr << std::put_time(tmPtr, "%Y-%m-%d %H:%M:%S");
+    timeStr << "." << std::setfill('0') << std::setw(3) << ms % 1'000;
+    
+    std::cout << "[TASK START] Task " << taskId << " started at " << timeStr.str() 
+              << " for text: " << textName << (cachedResult ? " (cached)" : "") << std::endl;
+
+    if ( cachedResult ) {
+        if ( not replayResult(transport, taskId, ms, *cachedResult) ) {
+            std::cerr << "Error: Cannot send cached result of task " << taskId << std::endl;
+        }
+        return taskId;
+    }
+
+    publishTask(dbConn, transport, taskId);
+    return taskId;
+}
+
+// Finishes publishing tasks a previous splitter left half-published.
+// Tasks another live splitter is still publishing are skipped.
+inline int resumeTasks(pqxx::connection& dbConn, Transport& transport) {
+    std::vector<int> taskIds;
+    {
+        pqxx::read_transaction txn(dbConn);
+        auto result = txn.exec("SELECT id FROM tasks WHERE status = 'publishing' ORDER BY id");
+        for ( const auto& row : result ) {
+            taskIds.push_back(row[0].as<int>());
+        }
+    }
+
+    int resumed = 0;
+    for ( int taskId : taskIds ) {
+        if ( publishTask(dbConn, transport, taskId) ) {
+            std::cout << "[TASK RESUME] Task " << taskId << " published" << std::endl;
+            ++resumed;
+        }
+    }
+    return resumed;
+}
+
+// Creates tasks for many texts from jobs threads at once. Each thread has its
+// own database connection and a transport from makeTransport, so lookups and
+// publishing of different texts overlap. Returns the ids of created tasks.
+inline std::vector<int> submitTexts(const std::vector<std::string>& textNames, int jobs, const std::string& tenant,
+                                    const std::function<std::unique_ptr<Transport>()>& makeTransport) {
+    std::atomic<size_t> next{0};
+    std::mutex idsMutex;
+    std::vector<int> taskIds;
+    std::vector<std::thread> threads;
+
+    jobs = std::clamp(jobs, 1, static_cast<int>(std::max<size_t>(1, textNames.size())));
+    for ( int i = 0; i < jobs; ++i ) {
+        threads.emplace_back([&] {
+            auto transport = makeTransport();
+            if ( not transport ) { return; }
+
+            try {
+                pqxx::connection conn(DB_CONN_STRING);
+                for ( size_t j = next++; j < textNames.size(); j = next++ ) {
+                    if ( int taskId = createTask(conn, *transport, textNames[j], tenant); taskId != 0 ) {
+                        std::lock_guard lock(idsMutex);
+                        taskIds.push_back(taskId);
+                    }
+                }
+            } catch ( const std::exception& e ) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+        });
+    }
+
+    for ( auto& thread : threads ) {
+        thread.join();
+    }
+    return taskIds;
+}
@@ -1,25 +1,44 @@
 #include <algorithm>
-#include <cstddef>
+#include <atomic>
 #include <iostream>
 #include <pqxx/connection.hxx>
-#include <string>
 #include <csignal>
+#include <string>
 
+#include "args.hpp"
 #include "constants.hpp"
-#include "handlers.hpp"
-#include "messages.hpp"
 #include "rabbitmq.hpp"
+#include "routing.hpp"
+#include "shm.hpp"
+#include "worker.hpp"
 
-static volatile int run = 1;
+static std::atomic<int> run = 1;
 
 static void stop(int sig) {
     run = 0;
 }
 
+static void printUsage() {
+    std::cout << "Usage: worker [-g <group>]" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
     signal(SIGINT, stop);
     signal(SIGTERM, stop);
 
+    // -g picks the worker group; by default a host's workers share one.
+    int group = WORKER_GROUPS > 0 and WORK_DISTRIBUTION == "push" ? routing::hostGroup() : -1;
+    for ( int i = 1; i < argc; ++i ) {
+        std::string arg = argv[i];
+        if ( arg == "-g" and i + 1 < argc and WORKER_GROUPS > 0 ) {
+            if ( not args::parseInt(argv[++i], group, 0) ) {
+                printUsage();
+                return 1;
+            }
+            group %= std::max(WORKER_GROUPS, 1);
+        }
+    }
+
     pqxx::connection conn{DB_CONN_STRING};
     
     if ( not conn.is_open() ) {
@@ -33,52 +52,21 @@ int main(int argc, char* argv[]) {
         std::cerr << "Error: Cannot connect to RabbitMQ" << std::endl;
         return 1;
     }
-    
-    if ( not rmq.declareQueue(QUEUE_NAME) ) {
-        std::cerr << "Error: Cannot declare queue" << std::endl;
-        return 1;
-    }
-    
-    if ( not rmq.declareQueue(RESULTS_QUEUE_NAME) ) {
-        std::cerr << "Error: Cannot declare results queue" << std::endl;
-        return 1;
-    }
-    
-    if ( not rmq.startConsuming(QUEUE_NAME) ) {
-        std::cerr << "Error: Cannot start consuming" << std::endl;
-        return 1;
+
+    if ( not rmq.setCompression(COMPRESSION_CODEC, COMPRESSION_THRESHOLD, COMPRESSION_DICTIONARY_PATH) ) {
+        std::cerr << "Warning: Compression is unavailable, publishing uncompressed" << std::endl;
     }
-    
-    std::cout << "Worker started." << std::endl;
-    
-    while ( run ) {
-        std::string message;
-        
-        if ( rmq.receiveMessage(message, 1) ) {
-            auto task = messages::TaskMessage::fromJson(message);
-            // std::cout << "Got message with id=" << task.taskId << std::endl
-            //     << "total_sections=" << task.totalSections << std::endl
-            //     << "start_time=" << task.startTime << std::endl
-            //     << "sectionIds=[";
-            // for ( auto sectionId : task.sectionIds ) {
-            //     std::cout << sectionId << ",";
-            // }
-            // std::cout << "]" << std::endl;
-            auto sections = getAllSections(conn, task.sectionIds);
-            messages::ResultMessage result;
-            result.taskId = task.taskId;
-            result.sectionsCount = sections.size();
-            result.totalSections = task.totalSections;
-            result.startTime = task.startTime; 
 
-            for ( auto handler : handlers::handlers ) {
-                handler(sections, result);
-            }
-            // std::cout << result.toJson() << std::endl;
-            rmq.sendMessage(result.toJson(), RESULTS_QUEUE_NAME);
-        }
+    // One unacknowledged batch per worker, so the backlog stays visible in
+    // QUEUE_NAME where the scheduler can see it. runWorker acknowledges a
+    // batch only once it is processed, so a crashed worker's batch is
+    // redelivered.
+    rmq.setPrefetch(1);
+
+    if ( RESULTS_TRANSPORT == "shm" ) {
+        ShmTransport shm{SHM_RING_BYTES};
+        return runWorker(conn, rmq, shm, run, group);
     }
-    
-    std::cout << "Shutting down worker..." << std::endl;
-    return 0;
+
+    return runWorker(conn, rmq, rmq, run, group);
 }
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <pqxx/pqxx>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+
+#include "constants.hpp"
+#include "handlers.hpp"
+#include "messages.hpp"
+#include "routing.hpp"
+#include "sections.hpp"
+#include "streaming.hpp"
+#include "transport.hpp"
+
+struct ProcessedBatch {
+    int taskId;
+    int firstSection;
+    size_t sections;
+};
+
+inline ProcessedBatch processTask(db::SectionReader& reader, Transport& results, std::string_view message, std::string& output)
+{
+    auto task = messages::TaskMessage::fromJson(message);
+
+    // Views into either the pushed contents or the reader's last result.
+    std::vector<std::string_view> sections;
+    std::vector<text::SectionStats> stats;
+    if ( task.sections.empty() ) {
+        reader.fetch(task.textId, task.firstSection, task.lastSection, sections, stats);
+    } else {
+        sections.assign(task.sections.begin(), task.sections.end());
+    }
+
+    messages::ResultMessage result;
+    result.taskId = task.taskId;
+    result.sectionsCount = sections.size();
+    result.totalSections = task.totalSections;
+    result.startTime = task.startTime;
+    result.firstSection = task.firstSection;
+
+    if ( stats.empty() ) {
+        for ( auto handler : handlers::handlers ) {
+            handler(sections, result);
+        }
+    } else {
+        handlers::mergeStats(sections, stats, result);
+        for ( auto handler : handlers::textHandlers ) {
+            handler(sections, result);
+        }
+    }
+
+    // A result that never left is a failed batch: it must not be reported
+    // done to the scheduler.
+    if ( not streaming::sendResult(results, routing::resultsQueueFor(task.taskId), result, output) ) {
+        throw std::runtime_error("Cannot send result of task " + std::to_string(task.taskId) + " (sections " +
+                                 std::to_string(task.firstSection) + "-" + std::to_string(task.lastSection) + ")");
+    }
+    return {task.taskId, task.firstSection, sections.size()};
+}
+
+// Processes one batch without letting a failure take the worker down, e.g.
+// packed sections on a worker built without zstd or a lost database
+// connection. With requeueTo set, a failed batch is put back there once for
+// another worker and reported to the aggregator as failed the second time,
+// so its task still finishes. Without it the batch is left to the
+// scheduler, which re-issues it.
+inline std::optional<ProcessedBatch> tryTask(db::SectionReader& reader, Transport& tasks, Transport& results,
+                                             std::string_view message, std::string& output,
+                                             const std::string& requeueTo = "")
+{
+    try {
+        return processTask(reader, results, message, output);
+    } catch ( const std::exception& e ) {
+        std::cerr << "Error: Cannot process batch: " << e.what() << std::endl;
+    }
+
+    if ( requeueTo.empty() ) { return std::nullopt; }
+
+    try {
+        auto task = messages::TaskMessage::fromJson(message);
+        if ( task.retried ) {
+            std::cerr << "Error: Batch of task " << task.taskId << " (sections " << task.firstSection << "-"
+                      << task.lastSection << ") failed twice, reporting it failed" << std::endl;
+            auto failed = messages::ResultMessage::failedBatch(task);
+            if ( not streaming::sendResult(results, routing::resultsQueueFor(task.taskId), failed, output) ) {
+                std::cerr << "Error: Cannot report failed batch of task " << task.taskId << std::endl;
+            }
+            return std::nullopt;
+        }
+        task.retried = true;
+        if ( not tasks.sendMessage(task.toJson(), requeueTo) ) {
+            std::cerr << "Error: Cannot requeue batch of task " << task.taskId << std::endl;
+        }
+    } catch ( const std::exception& e ) {
+        std::cerr << "Error: Dropping undecodable batch: " << e.what() << std::endl;
+    }
+    return std::nullopt;
+}
+
+inline std::string newWorkerId()
+{
+    static std::atomic<int> counter{0};
+
+    char host[64] = {};
+    gethostname(host, sizeof(host) - 1);
+    return std::string(host) + "." + std::to_string(getpid()) + "." + std::to_string(counter++);
+}
+
+// Pull mode: asks the scheduler for work on WORK_REQUESTS_QUEUE_NAME and
+// processes what comes back on the worker's own queue, reporting its rate
+// with every request so the assignments follow how fast this host is.
+inline void pullWork(db::SectionReader& reader, Transport& tasks, Transport& results, const std::atomic<int>& run)
+{
+    messages::WorkRequest request;
+    request.workerId = newWorkerId();
+    auto queueName = routing::workerQueueName(request.workerId);
+
+    // The presence consumer comes first: the in-process transport receives
+    // from the queue consumed last.
+    if ( not tasks.declareQueue(WORK_REQUESTS_QUEUE_NAME) or not tasks.declareQueue(WORKER_PRESENCE_QUEUE_NAME) or
+         not tasks.declareTemporaryQueue(queueName) or not tasks.startConsuming(WORKER_PRESENCE_QUEUE_NAME) or
+         not tasks.startConsuming(queueName) ) {
+        std::cerr << "Error: Cannot set up pull queues" << std::endl;
+        return;
+    }
+
+    std::cout << "Worker " << request.workerId << " started in pull mode." << std::endl;
+
+    std::string_view message;
+    std::string output;
+    auto requestedAt = std::chrono::steady_clock::time_point{};
+
+    while ( run ) {
+        auto now = std::chrono::steady_clock::now();
+        if ( now - requestedAt >= std::chrono::seconds(WORK_REQUEST_TIMEOUT_SEC) ) {
+            tasks.sendMessage(request.toJson(), WORK_REQUESTS_QUEUE_NAME);
+            requestedAt = now;
+        }
+
+        if ( not tasks.receiveView(message, 1) ) { continue; }
+
+        auto started = std::chrono::steady_clock::now();
+        auto processed = tryTask(reader, tasks, results, message, output);
+        tasks.acknowledge();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+        requestedAt = {};
+        // A failed batch is not reported, so the scheduler re-issues it.
+        if ( not processed ) { continue; }
+
+        double rate = processed->sections / std::max(elapsed.count(), 1e-3);
+        request.sectionsPerSecond = request.sectionsPerSecond > 0 ? 0.7 * request.sectionsPerSecond + 0.3 * rate : rate;
+        request.completed.assign(1, {processed->taskId, processed->firstSection});
+    }
+}
+
+// Text affinity: batches of the worker's group come first, overflow from
+// the shared queue only when the group queue is empty.
+inline bool receiveGrouped(Transport& tasks, std::string_view& message, std::string& overflow)
+{
+    if ( tasks.receiveView(message, 0) ) { return true; }
+    if ( tasks.getMessage(QUEUE_NAME, overflow) ) {
+        message = overflow;
+        return true;
+    }
+    return tasks.receiveView(message, 1);
+}
+
+// Tasks and results may travel over different transports, e.g. AMQP for
+// tasks and a shared-memory ring for results to a co-located aggregator.
+// A worker with a group consumes that group's queue (see WORKER_GROUPS).
+inline int runWorker(pqxx::connection& conn, Transport& tasks, Transport& results, const std::atomic<int>& run,
+                     int group = -1)
+{
+    std::string queueName = group >= 0 ? routing::groupQueueName(group) : QUEUE_NAME;
+
+    if ( not tasks.declareQueue(QUEUE_NAME) or not tasks.declareQueue(queueName) ) {
+        std::cerr << "Error: Cannot declare queue" << std::endl;
+        return 1;
+    }
+
+    for ( int shard = 0; shard < RESULT_SHARDS; ++shard ) {
+        if ( not results.declareQueue(routing::resultsQueueName(shard)) ) {
+            std::cerr << "Error: Cannot declare results queue" << std::endl;
+            return 1;
+        }
+    }
+
+    // The cache only saves round trips, so a worker without it still runs.
+    std::unique_ptr<shm::SectionCache> cache;
+    if ( SECTION_CACHE_BYTES > 0 ) {
+        cache = std::make_unique<shm::SectionCache>();
+        if ( not cache->open(SECTION_CACHE_NAME, SECTION_CACHE_BYTES, LOADER_SECTION_BYTES) ) {
+            std::cerr << "Warning: Cannot open section cache, reading from the database only" << std::endl;
+            cache.reset();
+        }
+    }
+
+    db::SectionReader reader{conn, cache.get()};
+    tasks.setDeferredAck(true);
+
+    if ( WORK_DISTRIBUTION == "pull" ) {
+        pullWork(reader, tasks, results, run);
+        std::cout << "Shutting down worker..." << std::endl;
+        return 0;
+    }
+
+    if ( not tasks.startConsuming(queueName) ) {
+        std::cerr << "Error: Cannot start consuming" << std::endl;
+        return 1;
+    }
+
+    if ( group >= 0 ) {
+        std::cout << "Worker started in group " << group << "." << std::endl;
+    } else {
+        std::cout << "Worker started." << std::endl;
+    }
+
+    std::string_view message;
+    std::string output;
+    std::string overflow;
+
+    while ( run ) {
+        bool received = group >= 0 ? receiveGrouped(tasks, message, overflow) : tasks.receiveView(message, 1);
+        if ( received ) {
+            tryTask(reader, tasks, results, message, output, queueName);
+            tasks.acknowledge();
+        }
+    }
+
+    std::cout << "Shutting down worker..." << std::endl;
+    return 0;
+}